@@ -12,6 +12,7 @@
 #include <math.h>
 
 #define MAX_CACHE_SIZE 256  // blocks
+#define MAX_TLB_SIZE 65536  // entries, for caches of translations
 #define MAX_BLOCK_SIZE 256 // bytes
 #define MIN_BLOCK_SIZE 4 // bytes
 
@@ -36,13 +37,19 @@ typedef struct blockStruct
 
 typedef struct cacheStruct
 {
-    blockStruct blocks[MAX_CACHE_SIZE];
+    blockStruct* blocks;   // numSets * blocksPerSet, allocated at init
+    bool verbose;          // log every action (off for TLBs)
     u_int32_t blockSize;
     u_int32_t numSets;
     u_int32_t blocksPerSet;
     u_int32_t offsetBits;
     u_int32_t indexBits;
     u_int32_t tagBits;
+    // details of the most recent access, for profiling
+    u_int32_t lastSet;
+    bool lastEvicted;     // a valid block was replaced
+    bool lastWriteback;   // ...and it was dirty
+    u_int32_t lastVictimAddr;
 } cacheStruct;
 
 /* Global Cache variable */
@@ -50,6 +57,8 @@ cacheStruct cache;
 
 void printAction(u_int32_t, u_int32_t, enum actionType);
 void printCache();
+void cache_setup(cacheStruct*, u_int32_t, u_int32_t, u_int32_t, bool);
+bool cache_lookup(cacheStruct*, u_int32_t, bool);
 
 /*
  * Set up the cache with given command line parameters. This is 
@@ -72,19 +81,7 @@ void cache_init(u_int32_t blockSize, u_int32_t numSets, u_int32_t blocksPerSet){
 		printf("Invalid cache design");
 		exit(0);
 	}
-	// Initialize cache struct members
-	cache.blockSize = blockSize;
-	cache.numSets = numSets;
-	cache.blocksPerSet = blocksPerSet;
-	cache.offsetBits = log2(cache.blockSize);
-	cache.indexBits = log2(cache.numSets);
-	cache.tagBits = 32 - cache.offsetBits - cache.indexBits;
-	int temp;
-	// Initialize cache blocks and set metadata
-	for(int i = 0; i < cache.numSets*cache.blocksPerSet; i++){
-		temp = i/cache.blocksPerSet;
-		cache.blocks[i].set = temp;
-	}
+	cache_setup(&cache, blockSize, numSets, blocksPerSet, true);
 	// Print cache configuration for debugging
 	printCache();
      
@@ -92,6 +89,33 @@ void cache_init(u_int32_t blockSize, u_int32_t numSets, u_int32_t blocksPerSet){
 }
 
 
+/*
+ * Initialize any set-associative structure `c` (the data cache, or a TLB
+ * whose "blocks" are page translations). Geometry is not validated here.
+ */
+void cache_setup(cacheStruct* c, u_int32_t blockSize, u_int32_t numSets, u_int32_t blocksPerSet, bool verbose){
+	// Initialize cache struct members
+	c->blockSize = blockSize;
+	c->numSets = numSets;
+	c->blocksPerSet = blocksPerSet;
+	c->verbose = verbose;
+	c->offsetBits = log2(c->blockSize);
+	c->indexBits = log2(c->numSets);
+	c->tagBits = 32 - c->offsetBits - c->indexBits;
+	c->blocks = calloc(numSets * blocksPerSet, sizeof(blockStruct));
+	if (c->blocks == NULL) {
+		printf("Could not allocate cache blocks");
+		exit(0);
+	}
+	int temp;
+	// Initialize cache blocks and set metadata
+	for(int i = 0; i < c->numSets*c->blocksPerSet; i++){
+		temp = i/c->blocksPerSet;
+		c->blocks[i].set = temp;
+	}
+}
+
+
 /*
  * Access the cache. This is the main part of the project,
  * and should call printAction as is appropriate.
@@ -109,28 +133,40 @@ bool cache_access(u_int32_t addr, bool read) {
     // See instructions for more details.
     
 
+    return cache_lookup(&cache, addr, read);
+}
+
+
+/*
+ * Look up `addr` in the set-associative structure `c`, filling it on a
+ * miss with LRU replacement; returns `true` on a hit.
+ */
+bool cache_lookup(cacheStruct* c, u_int32_t addr, bool read) {
     // check if cache params are within valid range
     	enum actionType type;
     	bool toRet = false;
 	// Extract address components
 	u_int32_t modAddr = addr;
-	u_int32_t offsetAnd = (pow(2,cache.offsetBits)-1);
+	u_int32_t offsetAnd = (pow(2,c->offsetBits)-1);
 	u_int32_t offset = addr & offsetAnd;
-	modAddr = modAddr >> cache.offsetBits;
-	u_int32_t test = pow(2, cache.indexBits)-1;
+	modAddr = modAddr >> c->offsetBits;
+	u_int32_t test = pow(2, c->indexBits)-1;
 	u_int32_t index = modAddr & test;
-	printf("no off %u and val: %u\n",modAddr, test); // debugging statement
-	u_int32_t tag = modAddr >> cache.indexBits;
-	printf("Addr: %u\nTag: %u\nIndex: %u\nBlockTag: %u\nRead? (1 is true): %d\n", addr, tag, index, cache.blocks[index].tag, read); // more debugging
+	if (c->verbose) printf("no off %u and val: %u\n",modAddr, test); // debugging statement
+	u_int32_t tag = modAddr >> c->indexBits;
+	c->lastSet = index;
+	c->lastEvicted = false;
+	c->lastWriteback = false;
+	if (c->verbose) printf("Addr: %u\nTag: %u\nIndex: %u\nBlockTag: %u\nRead? (1 is true): %d\n", addr, tag, index, c->blocks[index].tag, read); // more debugging
 	// check if cache params are within valid range
-	u_int32_t setIndex = index * cache.blocksPerSet;
+	u_int32_t setIndex = index * c->blocksPerSet;
 	u_int32_t currIndex = setIndex;
-	u_int32_t nextSetIndex = (setIndex+cache.blocksPerSet);
-	printf("Index: %u, NextSetIndex: %u\n", index, nextSetIndex); // debugging again
+	u_int32_t nextSetIndex = (setIndex+c->blocksPerSet);
+	if (c->verbose) printf("Index: %u, NextSetIndex: %u\n", index, nextSetIndex); // debugging again
 	
 	while(!toRet && currIndex < nextSetIndex) { 
-		if(tag == cache.blocks[currIndex].tag && cache.blocks[currIndex].valid) {
-			printf("Tag: %u, Cache block tag: %u\n", tag, cache.blocks[currIndex].tag);
+		if(tag == c->blocks[currIndex].tag && c->blocks[currIndex].valid) {
+			if (c->verbose) printf("Tag: %u, Cache block tag: %u\n", tag, c->blocks[currIndex].tag);
 			toRet = true; // check if cache params are within valid range
 
 		}
@@ -149,37 +185,41 @@ bool cache_access(u_int32_t addr, bool read) {
 		bool invalFound = false;
 		// iterate thru the blocks in the set to find the victim block
 		for(int i = setIndex; i < nextSetIndex; i++) { 
-			cache.blocks[i].lruLabel = cache.blocks[i].lruLabel + 1;
+			c->blocks[i].lruLabel = c->blocks[i].lruLabel + 1;
 			// if if block has higher LRU set victim to higher LRU block
-			if(cache.blocks[i].lruLabel > maxLabel&& !invalFound) {
+			if(c->blocks[i].lruLabel > maxLabel&& !invalFound) {
 				victimIndex = i;
-				maxLabel = cache.blocks[i].lruLabel;
+				maxLabel = c->blocks[i].lruLabel;
 			}
 			// if invalid mark as victim block
-			if(!cache.blocks[i].valid) {
+			if(!c->blocks[i].valid) {
 				victimIndex = i;
 				invalFound = true;
-				maxLabel = cache.blocks[i].lruLabel;
+				maxLabel = c->blocks[i].lruLabel;
 			}
-			printf("Block index: %u, its Lru: %u\n", i, cache.blocks[i].lruLabel);			
+			if (c->verbose) printf("Block index: %u, its Lru: %u\n", i, c->blocks[i].lruLabel);			
 		}
 
-		u_int32_t victimAddr = cache.blocks[victimIndex].tag << cache.indexBits;
+		u_int32_t victimAddr = c->blocks[victimIndex].tag << c->indexBits;
 		// calc victim address by using TIO
 		victimAddr = victimAddr + index;
-		victimAddr = victimAddr << cache.offsetBits;
+		victimAddr = victimAddr << c->offsetBits;
+		// record the eviction for profiling
+		c->lastEvicted = c->blocks[victimIndex].valid;
+		c->lastWriteback = c->blocks[victimIndex].valid && c->blocks[victimIndex].dirty;
+		c->lastVictimAddr = victimAddr;
 		// determine if block is dirty and needs to be written back
-		if(cache.blocks[victimIndex].dirty) {
-			printAction(victimAddr,cache.blockSize,cacheToMemory);
+		if(c->blocks[victimIndex].dirty) {
+			if (c->verbose) printAction(victimAddr,c->blockSize,cacheToMemory);
 		}
 		else { 
-			printAction(victimAddr,cache.blockSize,cacheToNowhere);
+			if (c->verbose) printAction(victimAddr,c->blockSize,cacheToNowhere);
 		}
 		// update metadata for the victim block and prepare for new data
-		printf("Evict index: %u, and its Lru: %u\n", victimIndex,cache.blocks[victimIndex].lruLabel);
-		cache.blocks[victimIndex].valid = true;
-		cache.blocks[victimIndex].dirty = false;
-		cache.blocks[victimIndex].tag = tag; // update tag
+		if (c->verbose) printf("Evict index: %u, and its Lru: %u\n", victimIndex,c->blocks[victimIndex].lruLabel);
+		c->blocks[victimIndex].valid = true;
+		c->blocks[victimIndex].dirty = false;
+		c->blocks[victimIndex].tag = tag; // update tag
 		currIndex = victimIndex; // update victim index
 
 	}
@@ -187,19 +227,19 @@ bool cache_access(u_int32_t addr, bool read) {
 	else {
 		// update lru labels for each cache hit	
 		for(int j = setIndex; j < nextSetIndex; j++) {
-			cache.blocks[j].lruLabel = cache.blocks[j].lruLabel + 1;	
+			c->blocks[j].lruLabel = c->blocks[j].lruLabel + 1;	
 		}
 	}
 	// print cache access action
-	cache.blocks[currIndex].lruLabel = 0;
+	c->blocks[currIndex].lruLabel = 0;
 	if(!read) {
-		cache.blocks[currIndex].dirty = true; // set dirty bit to true
+		c->blocks[currIndex].dirty = true; // set dirty bit to true
 		type = processorToCache;	
 	}
 	else {
 		type = cacheToProcessor;
 	}
-	printAction((addr-offset), cache.blockSize, type);
+	if (c->verbose) printAction((addr-offset), c->blockSize, type);
     return toRet;
 }
 
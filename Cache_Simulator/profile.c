@@ -0,0 +1,428 @@
+/* Profiling mode for the cache simulator.
+ * Reuse distance is the number of distinct blocks touched between two
+ * accesses to the same block. It is computed exactly with a Fenwick tree
+ * over access timestamps, where only the latest access of each block is
+ * marked; timestamps are renumbered whenever the tree fills up, so memory
+ * stays proportional to the number of distinct blocks, not the trace.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+#define EMPTY_KEY UINT64_MAX
+#define MIN_MAP_SLOTS 1024
+#define MIN_TREE_SIZE 4096
+
+// Open-addressing hash map from a 32-bit key to a long
+typedef struct keyMap {
+    uint64_t* keys;
+    long* values;
+    long slots;   // always a power of two
+    long used;
+} keyMap;
+
+static keyMap regionIndex; // bucket number -> index into regions
+static keyMap lastUse;     // block number -> timestamp of its latest access
+
+static regionStats* regions;
+static long numRegions;
+static long regionCapacity;
+static bool useRanges;     // regions come from a ranges file
+static uint32_t bucketSize;
+
+static setStats* sets;
+static uint32_t numSetsProfiled;
+static uint32_t blockShift;
+
+static long* tree;         // Fenwick tree over timestamps
+static long treeSize;
+static long now;
+
+/*
+ * Hash map helpers
+ */
+static uint64_t hashKey(uint64_t key){
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static void mapInit(keyMap* map, long slots){
+    map->slots = slots;
+    map->used = 0;
+    map->keys = malloc(slots * sizeof(uint64_t));
+    map->values = malloc(slots * sizeof(long));
+    if (map->keys == NULL || map->values == NULL) {
+        printf("Out of memory for profiling\n");
+        exit(-1);
+    }
+    memset(map->keys, 0xff, slots * sizeof(uint64_t));
+}
+
+// Return the slot holding `key`, or the empty slot where it belongs
+static long mapSlot(keyMap* map, uint64_t key){
+    long slot = hashKey(key) & (map->slots - 1);
+    while (map->keys[slot] != EMPTY_KEY && map->keys[slot] != key) {
+        slot = (slot + 1) & (map->slots - 1);
+    }
+    return slot;
+}
+
+static void mapGrow(keyMap* map){
+    keyMap bigger;
+    mapInit(&bigger, map->slots * 2);
+    for (long i = 0; i < map->slots; i++) {
+        if (map->keys[i] != EMPTY_KEY) {
+            long slot = mapSlot(&bigger, map->keys[i]);
+            bigger.keys[slot] = map->keys[i];
+            bigger.values[slot] = map->values[i];
+            bigger.used++;
+        }
+    }
+    free(map->keys);
+    free(map->values);
+    *map = bigger;
+}
+
+// Find `key`, inserting it with `value` if it is absent; returns its slot
+static long mapFindOrInsert(keyMap* map, uint64_t key, long value, bool* found){
+    if ((map->used + 1) * 4 > map->slots * 3) {
+        mapGrow(map);
+    }
+    long slot = mapSlot(map, key);
+    *found = map->keys[slot] == key;
+    if (!*found) {
+        map->keys[slot] = key;
+        map->values[slot] = value;
+        map->used++;
+    }
+    return slot;
+}
+
+/*
+ * Fenwick tree helpers
+ */
+static void treeAdd(long pos, long delta){
+    for (long i = pos + 1; i <= treeSize; i += i & -i) {
+        tree[i] += delta;
+    }
+}
+
+// Sum of marks at timestamps [0, pos]
+static long treePrefix(long pos){
+    long sum = 0;
+    for (long i = pos + 1; i > 0; i -= i & -i) {
+        sum += tree[i];
+    }
+    return sum;
+}
+
+static int compareSlotsByTime(const void* a, const void* b){
+    long ta = lastUse.values[*(const long*) a];
+    long tb = lastUse.values[*(const long*) b];
+    return (ta > tb) - (ta < tb);
+}
+
+// Renumber live timestamps to 0..n-1 (keeping their order) and rebuild
+// the tree, doubling it if more than half of it would stay occupied
+static void compactTimestamps(){
+    long live = lastUse.used;
+    long* order = malloc(live * sizeof(long));
+    long n = 0;
+    for (long i = 0; i < lastUse.slots; i++) {
+        if (lastUse.keys[i] != EMPTY_KEY) {
+            order[n++] = i;
+        }
+    }
+    qsort(order, n, sizeof(long), compareSlotsByTime);
+    for (long i = 0; i < n; i++) {
+        lastUse.values[order[i]] = i;
+    }
+    free(order);
+
+    while (live * 2 > treeSize) {
+        treeSize *= 2;
+    }
+    free(tree);
+    tree = calloc(treeSize + 1, sizeof(long));
+    // linear-time build: every timestamp below `live` is marked
+    for (long i = 1; i <= treeSize; i++) {
+        if (i <= live) {
+            tree[i] += 1;
+        }
+        long parent = i + (i & -i);
+        if (parent <= treeSize) {
+            tree[parent] += tree[i];
+        }
+    }
+    now = live;
+}
+
+// Record an access to `block`; returns its histogram bucket
+static int reuseBucket(uint32_t block, bool* cold){
+    if (now == treeSize) {
+        compactTimestamps();
+    }
+    bool found;
+    long slot = mapFindOrInsert(&lastUse, block, now, &found);
+    int bucket = 0;
+    if (found) {
+        long last = lastUse.values[slot];
+        long distance = treePrefix(now - 1) - treePrefix(last);
+        treeAdd(last, -1);
+        lastUse.values[slot] = now;
+        bucket = 1;
+        while (distance > 0 && bucket < REUSE_BUCKETS - 1) {
+            distance >>= 1;
+            bucket++;
+        }
+    }
+    treeAdd(now, 1);
+    now++;
+    *cold = !found;
+    return bucket;
+}
+
+/*
+ * Region helpers
+ */
+static regionStats* addRegion(uint32_t start, uint32_t end, const char* name){
+    if (numRegions == regionCapacity) {
+        regionCapacity = regionCapacity == 0 ? 64 : regionCapacity * 2;
+        regions = realloc(regions, regionCapacity * sizeof(regionStats));
+        if (regions == NULL) {
+            printf("Out of memory for profiling\n");
+            exit(-1);
+        }
+    }
+    regionStats* region = &regions[numRegions++];
+    memset(region, 0, sizeof(regionStats));
+    region->start = start;
+    region->end = end;
+    strncpy(region->name, name, sizeof(region->name) - 1);
+    return region;
+}
+
+static int compareRegions(const void* a, const void* b){
+    const regionStats* ra = a;
+    const regionStats* rb = b;
+    return (ra->start > rb->start) - (ra->start < rb->start);
+}
+
+static regionStats* findRegion(uint32_t addr){
+    if (!useRanges) {
+        bool found;
+        uint32_t bucket = addr / bucketSize;
+        long slot = mapFindOrInsert(&regionIndex, bucket, numRegions, &found);
+        if (!found) {
+            uint32_t start = bucket * bucketSize;
+            addRegion(start, start + (bucketSize - 1), "");
+        }
+        return &regions[regionIndex.values[slot]];
+    }
+
+    // ranges are sorted by start; the catch-all region is last
+    long lo = 0, hi = numRegions - 2;
+    while (lo <= hi) {
+        long mid = (lo + hi) / 2;
+        if (addr < regions[mid].start) {
+            hi = mid - 1;
+        } else if (addr > regions[mid].end) {
+            lo = mid + 1;
+        } else {
+            return &regions[mid];
+        }
+    }
+    return &regions[numRegions - 1];
+}
+
+// Parse a bucket size such as 4096, 4K or 2M; returns 0 if not a size
+static uint32_t parseSize(const char* spec){
+    char* end;
+    unsigned long size = strtoul(spec, &end, 0);
+    if (end == spec) {
+        return 0;
+    }
+    if (*end == 'K' || *end == 'k') {
+        size *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        size *= 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0' || size == 0 || size > UINT32_MAX) {
+        return 0;
+    }
+    return size;
+}
+
+static bool loadRanges(const char* fileName){
+    FILE* rangesFile = fopen(fileName, "r");
+    if (rangesFile == NULL) {
+        printf("Could not open region ranges file %s\n", fileName);
+        return false;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), rangesFile)) {
+        unsigned int start, end;
+        char name[32] = "";
+        if (line[0] == '#' || sscanf(line, "%x %x %31s", &start, &end, name) < 2) {
+            continue;
+        }
+        if (end < start) {
+            printf("Ignoring empty region range: %s", line);
+            continue;
+        }
+        addRegion(start, end, name);
+    }
+    fclose(rangesFile);
+
+    qsort(regions, numRegions, sizeof(regionStats), compareRegions);
+    for (long i = 1; i < numRegions; i++) {
+        if (regions[i].start <= regions[i - 1].end) {
+            printf("Region ranges overlap at 0x%x\n", regions[i].start);
+            return false;
+        }
+    }
+    addRegion(0, UINT32_MAX, "other");
+    return true;
+}
+
+bool profile_init(const char* regionSpec, uint32_t numSets, uint32_t offsetBits){
+    bucketSize = parseSize(regionSpec);
+    useRanges = bucketSize == 0;
+    if (useRanges) {
+        if (!loadRanges(regionSpec)) {
+            return false;
+        }
+    } else {
+        mapInit(&regionIndex, MIN_MAP_SLOTS);
+    }
+
+    numSetsProfiled = numSets;
+    blockShift = offsetBits;
+    sets = calloc(numSets, sizeof(setStats));
+    mapInit(&lastUse, MIN_MAP_SLOTS);
+    treeSize = MIN_TREE_SIZE;
+    tree = calloc(treeSize + 1, sizeof(long));
+    now = 0;
+    return sets != NULL && tree != NULL;
+}
+
+void profile_access(uint32_t addr, bool read, bool hit, uint32_t set,
+                    bool evicted, bool writeback, uint32_t victimAddr){
+    bool cold;
+    int bucket = reuseBucket(addr >> blockShift, &cold);
+
+    regionStats* region = findRegion(addr);
+    region->accesses++;
+    if (read) {
+        region->reads++;
+    } else {
+        region->writes++;
+    }
+    if (hit) {
+        region->hits++;
+    } else {
+        region->misses++;
+    }
+    region->reuse[bucket]++;
+
+    setStats* setInfo = &sets[set];
+    setInfo->accesses++;
+    if (hit) {
+        setInfo->hits++;
+    } else {
+        setInfo->misses++;
+    }
+    if (cold) {
+        setInfo->distinctBlocks++;
+    }
+    if (evicted) {
+        setInfo->evictions++;
+    }
+    if (writeback) {
+        // the written-back data belongs to the victim's region
+        setInfo->writebacks++;
+        findRegion(victimAddr)->writebacks++;
+    }
+}
+
+static double rate(long part, long whole){
+    return whole == 0 ? 0.0 : (double) part / whole;
+}
+
+static FILE* openCsv(const char* prefix, const char* suffix){
+    char fileName[512];
+    snprintf(fileName, sizeof(fileName), "%s-%s.csv", prefix, suffix);
+    FILE* csv = fopen(fileName, "w");
+    if (csv == NULL) {
+        printf("Could not write profile file %s\n", fileName);
+    } else {
+        printf("\tWriting profile %s\n", fileName);
+    }
+    return csv;
+}
+
+bool profile_write_csv(const char* prefix){
+    if (!useRanges) {
+        // bucket regions were created in access order; the index map is
+        // no longer needed once they are sorted
+        qsort(regions, numRegions, sizeof(regionStats), compareRegions);
+    }
+
+    FILE* csv = openCsv(prefix, "regions");
+    if (csv == NULL) {
+        return false;
+    }
+    fprintf(csv, "start,end,name,accesses,reads,writes,hits,misses,miss_rate,writebacks\n");
+    for (long i = 0; i < numRegions; i++) {
+        regionStats* r = &regions[i];
+        if (r->accesses == 0 && r->writebacks == 0) {
+            continue;
+        }
+        fprintf(csv, "0x%08x,0x%08x,%s,%ld,%ld,%ld,%ld,%ld,%.6f,%ld\n",
+                r->start, r->end, r->name, r->accesses, r->reads, r->writes,
+                r->hits, r->misses, rate(r->misses, r->accesses), r->writebacks);
+    }
+    fclose(csv);
+
+    csv = openCsv(prefix, "sets");
+    if (csv == NULL) {
+        return false;
+    }
+    fprintf(csv, "set,accesses,hits,misses,miss_rate,evictions,writebacks,distinct_blocks\n");
+    for (uint32_t i = 0; i < numSetsProfiled; i++) {
+        setStats* s = &sets[i];
+        fprintf(csv, "%u,%ld,%ld,%ld,%.6f,%ld,%ld,%ld\n",
+                i, s->accesses, s->hits, s->misses, rate(s->misses, s->accesses),
+                s->evictions, s->writebacks, s->distinctBlocks);
+    }
+    fclose(csv);
+
+    csv = openCsv(prefix, "reuse");
+    if (csv == NULL) {
+        return false;
+    }
+    fprintf(csv, "start,end,name,cold,0");
+    for (int b = 2; b < REUSE_BUCKETS - 1; b++) {
+        fprintf(csv, ",%ld-%ld", 1L << (b - 2), (1L << (b - 1)) - 1);
+    }
+    fprintf(csv, ",%ld+\n", 1L << (REUSE_BUCKETS - 3));
+    for (long i = 0; i < numRegions; i++) {
+        regionStats* r = &regions[i];
+        if (r->accesses == 0) {
+            continue;
+        }
+        fprintf(csv, "0x%08x,0x%08x,%s", r->start, r->end, r->name);
+        for (int b = 0; b < REUSE_BUCKETS; b++) {
+            fprintf(csv, ",%ld", r->reuse[b]);
+        }
+        fprintf(csv, "\n");
+    }
+    fclose(csv);
+    return true;
+}
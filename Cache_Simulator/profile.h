@@ -0,0 +1,56 @@
+/* Profiling mode for the cache simulator.
+ * Attributes hits, misses and writebacks to address regions (fixed-size
+ * buckets such as 4 KB pages, or user-given ranges) and to individual
+ * sets, keeps a reuse-distance histogram per region, and exports all of
+ * it as CSV.
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Reuse-distance histogram: bucket 0 counts cold (first) accesses, bucket
+// 1 a distance of 0, and bucket b >= 2 distances in [2^(b-2), 2^(b-1)).
+// The last bucket also absorbs everything larger.
+#define REUSE_BUCKETS 26
+
+// Counters for one address region
+typedef struct regionStats {
+    uint32_t start;
+    uint32_t end;          // inclusive
+    char name[32];         // label from a ranges file, empty for buckets
+    long accesses;
+    long reads;
+    long writes;
+    long hits;
+    long misses;
+    long writebacks;       // dirty blocks of this region written back
+    long reuse[REUSE_BUCKETS];
+} regionStats;
+
+// Counters for one cache set
+typedef struct setStats {
+    long accesses;
+    long hits;
+    long misses;
+    long evictions;
+    long writebacks;
+    long distinctBlocks;   // blocks that ever mapped to this set
+} setStats;
+
+// Set up profiling. `regionSpec` is either a bucket size in bytes (a
+// number, optionally suffixed K or M) or the name of a ranges file with
+// lines of the form `<start hex> <end hex> [name]`. Returns false if the
+// spec cannot be used.
+bool profile_init(const char* regionSpec, uint32_t numSets, uint32_t offsetBits);
+
+// Record one access and its outcome
+void profile_access(uint32_t addr, bool read, bool hit, uint32_t set,
+                    bool evicted, bool writeback, uint32_t victimAddr);
+
+// Write <prefix>-regions.csv, <prefix>-sets.csv and <prefix>-reuse.csv;
+// returns false if any file could not be written
+bool profile_write_csv(const char* prefix);
+
+#endif
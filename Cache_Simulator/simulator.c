@@ -11,79 +11,74 @@
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include "simulator.h"
+#include "trace.h"
+#include "profile.h"
 #include "cache.c"
-
-#define MAX_ACCESS_COUNT 100 // accesses
+#include "tlb.c"
 
 // Global results variable
 results_s results;
 
-action_s access_list[MAX_ACCESS_COUNT];
-
 
 void printResults(){
     printf("\t**Summary of Cache Simulation Results**\n");
-    printf("\t\tTotal Accesses: \t%d\n", results.total_accesses);
-    printf("\t\tTotal Reads: \t%d\n", results.reads);
-    printf("\t\tTotal Writes: \t%d\n", results.writes);
-    printf("\t\tRead Cache Hits: \t%d\n", results.read_hits);
-    printf("\t\tRead Cache Misses: \t%d\n", results.read_misses);
-    printf("\t\tWrite Cache Hits: \t%d\n", results.write_hits);
-    printf("\t\tWrite Cache Misses: \t%d\n", results.write_misses);
+    printf("\t\tTotal Accesses: \t%ld\n", results.total_accesses);
+    printf("\t\tTotal Reads: \t%ld\n", results.reads);
+    printf("\t\tTotal Writes: \t%ld\n", results.writes);
+    printf("\t\tRead Cache Hits: \t%ld\n", results.read_hits);
+    printf("\t\tRead Cache Misses: \t%ld\n", results.read_misses);
+    printf("\t\tWrite Cache Hits: \t%ld\n", results.write_hits);
+    printf("\t\tWrite Cache Misses: \t%ld\n", results.write_misses);
 }
 
-void printTrace(){
+void printTrace(traceChunk* chunk){
     int i = 0;
-    printf("\tSummary of Access List from Trace Input: \n");
-    while (i < MAX_ACCESS_COUNT){
-        printf("\t\t%d : {Address, %x}, {Read, %d}\n", i, access_list[i].addr, access_list[i].read);  
+    printf("\tSummary of Access List from Trace Chunk: \n");
+    while (i < chunk->count){
+        printf("\t\t%d : {Address, %x}, {Read, %d}\n", i, chunk->actions[i].addr, chunk->actions[i].read);  
         i++;
     }
 }
 
 
-void parseTrace(FILE* tf){
-    // this parsing function relies on a simple and consistent format in the
-    // input tracing file; each line should have 1 char representing whether 
-    // the access is a read or a write (1 for read, 0 for write), 1 space, and
-    // then 8 characters representing the address of the access in hex format
-    // For examples, see provided traces
-    
-    // Go line by line in the file, initialize and assign access-by-access, update results, return accesses
-    results.total_accesses = 0;
-    results.reads = 0;
-    results.writes = 0;
-
-    int length = 12;
-    char line[length]; // assign to max length per line
-    bool read_write;
-
-    while (fgets(line, length, tf)) {
-        // split into read/write and address
-        read_write = (bool) atoi(line);
-        // assign read/write
-        access_list[results.total_accesses].read = read_write;
-        // assign address        
-        access_list[results.total_accesses].addr = strtoul(&line[2], NULL, 16);
-
-        results.total_accesses++;
-        if (read_write) {
-            results.reads++;
-        } else {
-            results.writes++;
-        }
-    } // stop reading when we reach end of the file
-
-    // optional; print results / trace after parsing to debug
-    //printResults();
-    //printTrace();
-}
-
 int main(int argc, char* argv[]){
     // simulator will take 2 command line arguments
     // argv[1] file name of cache config
     // argv[2] file name of example trace of memory accesses 
+    // optionally preceded by profiling options:
+    //   -P <prefix>  write per-region, per-set and reuse-distance CSVs
+    //   -r <spec>    region size (e.g. 4K) or ranges file; default 4K pages
+    // and TLB options:
+    //   -t <config>  also simulate a DTLB and STLB with this configuration
+    //   -m <map>     page size map of address ranges backed by other page sizes
+    char* profile_prefix = NULL;
+    char* region_spec = "4K";
+    char* tlb_config_file_name = NULL;
+    char* page_map_file_name = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "P:r:t:m:")) != -1) {
+        switch (opt) {
+        case 't':
+            tlb_config_file_name = optarg;
+            break;
+        case 'm':
+            page_map_file_name = optarg;
+            break;
+        case 'P':
+            profile_prefix = optarg;
+            break;
+        case 'r':
+            region_spec = optarg;
+            break;
+        default:
+            printf("Usage: %s [-P csv-prefix [-r region-size|ranges-file]] [-t tlb-config [-m page-map]] <config> <trace>\n", argv[0]);
+            return -1;
+        }
+    }
+    argv += optind - 1;
+    argc -= optind - 1;
     
     printf("\n ~~ COSC 171 Cache Simulator ~~\n");
 
@@ -120,44 +115,77 @@ int main(int argc, char* argv[]){
     // initialize cache using config
     printf("\tParsed Configuration; Initializing Cache.\n");
     cache_init(blockSize, numSets, blocksPerSet);
+    if (profile_prefix != NULL && !profile_init(region_spec, numSets, cache.offsetBits)) {
+        printf("Could not set up profiling with regions %s\n", region_spec);
+        return -1;
+    }
+    if (tlb_config_file_name != NULL) {
+        printf("\n\tFile name for TLB configuration is: %s\n", tlb_config_file_name);
+        if (!tlb_init(tlb_config_file_name, page_map_file_name)) {
+            return -1;
+        }
+    }
 
-    // next, parse input trace, set reads/writes/accesses 
-    // parseTrace returns array of actions
+    // next, stream the input trace; a producer thread decodes it (plain,
+    // gzip or zstd) into chunks of actions while we simulate
     char* memory_trace_file_name = argv[2];
     printf("\n\tFile name for memory address trace is: %s\n", memory_trace_file_name);
-    FILE* trace_file;
-
-    // open a file
-    trace_file = fopen(memory_trace_file_name, "r");
+    traceReader* trace = trace_open(memory_trace_file_name);
     // test if file opened successfully; exit if it failed
-    if (config_file == NULL) {
+    if (trace == NULL) {
         printf("Could not open memory trace file %s\n", memory_trace_file_name);
         return -1; 
-    } else {
-        printf("\tParsing Memory Trace file.\n");
-        parseTrace(trace_file);
     }
-    fclose(trace_file); // close a file when done with parsing
-
+    printf("\tStreaming Memory Trace file.\n");
 
     // now, we simulate action-by-action to record hits + misses
     // print lots of details along the way
-    for (int i=0; i<results.total_accesses; i++){
-        bool is_a_hit = cache_access(access_list[i].addr, access_list[i].read);
-        if (is_a_hit && access_list[i].read){
-            results.read_hits++;
-        } 
-        if (is_a_hit && !(access_list[i].read)){
-            results.write_hits++;
-        }
-        if(!is_a_hit && access_list[i].read){
-            results.read_misses++;
-        } 
-        if(!is_a_hit && !access_list[i].read) {
-            results.write_misses++;
+    traceChunk* chunk;
+    while ((chunk = trace_next_chunk(trace)) != NULL) {
+        // optional; print the chunk after parsing to debug
+        //printTrace(chunk);
+        for (int i=0; i<chunk->count; i++){
+            action_s* action = &chunk->actions[i];
+            results.total_accesses++;
+            if (action->read) {
+                results.reads++;
+            } else {
+                results.writes++;
+            }
+
+            if (tlb_config_file_name != NULL) {
+                tlb_access(action->addr);
+            }
+            bool is_a_hit = cache_access(action->addr, action->read);
+            if (is_a_hit && action->read){
+                results.read_hits++;
+            } 
+            if (is_a_hit && !(action->read)){
+                results.write_hits++;
+            }
+            if(!is_a_hit && action->read){
+                results.read_misses++;
+            } 
+            if(!is_a_hit && !action->read) {
+                results.write_misses++;
+            }
+            if (profile_prefix != NULL) {
+                profile_access(action->addr, action->read, is_a_hit, cache.lastSet,
+                               cache.lastEvicted, cache.lastWriteback, cache.lastVictimAddr);
+            }
         }
     }
+    if (!trace_close(trace)) {
+        printf("Could not decode memory trace file %s\n", memory_trace_file_name);
+        return -1;
+    }
 
     // print summary of results
     printResults();
+    if (tlb_config_file_name != NULL) {
+        tlb_print_results();
+    }
+    if (profile_prefix != NULL && !profile_write_csv(profile_prefix)) {
+        return -1;
+    }
 }
@@ -2,8 +2,12 @@
  * Inspired and adapted from CS 3410 @ Cornell
  * Lillian Pentecost, 2022
  */
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -13,13 +17,13 @@
 // reporting results
 
 typedef struct results {
-    int total_accesses;
-    int reads;
-    int writes;
-    int read_hits;
-    int write_hits;
-    int read_misses;
-    int write_misses;
+    long total_accesses;
+    long reads;
+    long writes;
+    long read_hits;
+    long write_hits;
+    long read_misses;
+    long write_misses;
 } results_s;
 
 // Define struct representing any 1 action
@@ -28,10 +32,8 @@ typedef struct action {
     bool read;
 } action_s;
 
-// Given an input file with a simple format, 
-// parse into an array of actions
-void parseTrace(FILE* tf);
-
 // print results
 void printResults();
 
+#endif
+
@@ -0,0 +1,202 @@
+/* A two-level data TLB model built on the set-associative cache in
+ * cache.c. Each entry caches one page translation, so lookups are keyed
+ * by virtual page number instead of block address. Pages default to one
+ * size, and a page-size map can mark address ranges as backed by larger
+ * (e.g. 2 MB) pages to estimate the benefit of huge pages.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define MAX_PAGE_RANGES 256
+#define MIN_PAGE_SHIFT 12 // 4 KB
+#define MAX_PAGE_SHIFT 30 // 1 GB
+
+// An address range backed by pages of one size
+typedef struct pageRange
+{
+    u_int32_t start;
+    u_int32_t end; // inclusive
+    u_int32_t pageShift;
+} pageRange;
+
+typedef struct tlbStruct
+{
+    cacheStruct dtlb;  // L1 data TLB
+    cacheStruct stlb;  // L2 shared TLB, looked up on DTLB misses
+    u_int32_t defaultPageShift;
+    pageRange ranges[MAX_PAGE_RANGES];
+    int numRanges;
+    // statistics
+    long accesses;
+    long dtlbMisses;
+    long stlbMisses;       // i.e. page walks
+    long hugeAccesses;     // accesses to pages larger than the default
+} tlbStruct;
+
+/* Global TLB variable */
+tlbStruct tlb;
+
+// Parse a page size such as 4096, 4K, 2M or 1G into its shift; 0 if invalid
+static u_int32_t parsePageShift(const char* spec){
+    char* end;
+    unsigned long size = strtoul(spec, &end, 0);
+    if (*end == 'K' || *end == 'k') {
+        size <<= 10;
+    } else if (*end == 'M' || *end == 'm') {
+        size <<= 20;
+    } else if (*end == 'G' || *end == 'g') {
+        size <<= 30;
+    }
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return 0;
+    }
+    u_int32_t shift = __builtin_ctzl(size);
+    if (shift < MIN_PAGE_SHIFT || shift > MAX_PAGE_SHIFT) {
+        return 0;
+    }
+    return shift;
+}
+
+// Check a TLB level's geometry; both dimensions must be powers of two
+static bool validTlbGeometry(const char* name, u_int32_t entriesPerSet, u_int32_t numSets){
+    u_int32_t entries = entriesPerSet * numSets;
+    if (entriesPerSet == 0 || numSets == 0 || (numSets & (numSets - 1)) != 0 || entries > MAX_TLB_SIZE) {
+        printf("Invalid %s design: %u sets of %u entries\n", name, numSets, entriesPerSet);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Read a page-size map: lines of `<start hex> <end hex> <page size>`.
+ * Ranges should be aligned to their page size; addresses outside every
+ * range use the default page size.
+ */
+static bool loadPageMap(const char* fileName){
+    FILE* mapFile = fopen(fileName, "r");
+    if (mapFile == NULL) {
+        printf("Could not open page size map %s\n", fileName);
+        return false;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), mapFile)) {
+        unsigned int start, end;
+        char size[32];
+        if (line[0] == '#' || sscanf(line, "%x %x %31s", &start, &end, size) != 3) {
+            continue;
+        }
+        u_int32_t shift = parsePageShift(size);
+        if (shift == 0 || end < start) {
+            printf("Ignoring invalid page size range: %s", line);
+            continue;
+        }
+        if (tlb.numRanges == MAX_PAGE_RANGES) {
+            printf("Too many page size ranges; ignoring the rest\n");
+            break;
+        }
+        u_int32_t pageMask = (1u << shift) - 1;
+        if ((start & pageMask) != 0 || ((end + 1) & pageMask) != 0) {
+            printf("Warning: range 0x%x-0x%x is not aligned to its page size\n", start, end);
+        }
+        tlb.ranges[tlb.numRanges].start = start;
+        tlb.ranges[tlb.numRanges].end = end;
+        tlb.ranges[tlb.numRanges].pageShift = shift;
+        tlb.numRanges++;
+    }
+    fclose(mapFile);
+    return true;
+}
+
+/*
+ * Set up the TLBs from a configuration file and an optional page-size map
+ * (NULL for none). Returns false if either cannot be used.
+ */
+bool tlb_init(const char* configFileName, const char* pageMapFileName){
+    FILE* configFile = fopen(configFileName, "r");
+    if (configFile == NULL) {
+        printf("Could not open TLB configuration file %s\n", configFileName);
+        return false;
+    }
+    char pageSize[32] = "";
+    u_int32_t dtlbEntriesPerSet = 0, dtlbSets = 0, stlbEntriesPerSet = 0, stlbSets = 0;
+    fscanf(configFile, "Page Size: %31s\n", pageSize);
+    fscanf(configFile, "DTLB Entries Per Set: %u\n", &dtlbEntriesPerSet);
+    fscanf(configFile, "DTLB Number of Sets: %u\n", &dtlbSets);
+    fscanf(configFile, "STLB Entries Per Set: %u\n", &stlbEntriesPerSet);
+    fscanf(configFile, "STLB Number of Sets: %u\n", &stlbSets);
+    fclose(configFile);
+
+    tlb.defaultPageShift = parsePageShift(pageSize);
+    if (tlb.defaultPageShift == 0) {
+        printf("Invalid TLB page size %s\n", pageSize);
+        return false;
+    }
+    if (!validTlbGeometry("DTLB", dtlbEntriesPerSet, dtlbSets) ||
+        !validTlbGeometry("STLB", stlbEntriesPerSet, stlbSets)) {
+        return false;
+    }
+    if (pageMapFileName != NULL && !loadPageMap(pageMapFileName)) {
+        return false;
+    }
+
+    // entries hold one translation each, so there is no offset within a "block"
+    cache_setup(&tlb.dtlb, 1, dtlbSets, dtlbEntriesPerSet, false);
+    cache_setup(&tlb.stlb, 1, stlbSets, stlbEntriesPerSet, false);
+
+    printf("\nTLB Design:\n");
+    printf("\t Default Page Size (B):\t%u\n", 1u << tlb.defaultPageShift);
+    printf("\t Page Size Ranges:\t%d\n", tlb.numRanges);
+    printf("\t DTLB:\t%u sets x %u entries\n", dtlbSets, dtlbEntriesPerSet);
+    printf("\t STLB:\t%u sets x %u entries\n", stlbSets, stlbEntriesPerSet);
+    return true;
+}
+
+// Page size (as a shift) backing `addr`
+static u_int32_t pageShiftOf(u_int32_t addr){
+    for (int i = 0; i < tlb.numRanges; i++) {
+        if (addr >= tlb.ranges[i].start && addr <= tlb.ranges[i].end) {
+            return tlb.ranges[i].pageShift;
+        }
+    }
+    return tlb.defaultPageShift;
+}
+
+/*
+ * Translate one access. The key is the virtual page number with the page
+ * size folded into its top bits: the set index comes from the low VPN
+ * bits, and translations of different page sizes never alias.
+ */
+void tlb_access(u_int32_t addr){
+    u_int32_t shift = pageShiftOf(addr);
+    u_int32_t key = (addr >> shift) | ((shift - MIN_PAGE_SHIFT + 1) << (32 - MIN_PAGE_SHIFT));
+
+    tlb.accesses++;
+    if (shift != tlb.defaultPageShift) {
+        tlb.hugeAccesses++;
+    }
+    if (cache_lookup(&tlb.dtlb, key, true)) {
+        return;
+    }
+    tlb.dtlbMisses++;
+    if (!cache_lookup(&tlb.stlb, key, true)) {
+        tlb.stlbMisses++;
+    }
+}
+
+static double missRate(long misses, long accesses){
+    return accesses == 0 ? 0.0 : (double) misses / accesses;
+}
+
+void tlb_print_results(){
+    printf("\t**Summary of TLB Simulation Results**\n");
+    printf("\t\tTotal Translations: \t%ld\n", tlb.accesses);
+    printf("\t\tOn Non-Default Pages: \t%ld\n", tlb.hugeAccesses);
+    printf("\t\tDTLB Misses: \t%ld\n", tlb.dtlbMisses);
+    printf("\t\tDTLB Miss Rate: \t%.4f\n", missRate(tlb.dtlbMisses, tlb.accesses));
+    printf("\t\tSTLB Misses (Page Walks): \t%ld\n", tlb.stlbMisses);
+    printf("\t\tSTLB Local Miss Rate: \t%.4f\n", missRate(tlb.stlbMisses, tlb.dtlbMisses));
+    printf("\t\tPage Walks per 1000 Accesses: \t%.2f\n", 1000.0 * missRate(tlb.stlbMisses, tlb.accesses));
+}
@@ -0,0 +1,231 @@
+/* Streaming reader for (optionally compressed) memory traces.
+ * Plain and gzip traces are decoded with zlib; zstd traces are piped
+ * through an external `zstd -dc` so no extra library is required.
+ * Either way a producer thread parses lines into chunks of actions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "trace.h"
+
+#define TRACE_LINE_LENGTH 64
+
+static const unsigned char zstdMagic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+/*
+ * Start `zstd -dc fileName` and return the read end of its output,
+ * or -1 if the decompressor could not be started. If zstd itself cannot
+ * be run the child exits with status 127, which trace_close() reports.
+ */
+static int spawnZstd(const char* fileName, pid_t* child){
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execlp("zstd", "zstd", "-dcq", "--", fileName, (char*) NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    *child = pid;
+    return fds[0];
+}
+
+/*
+ * Parse one trace line: 1 char for read (1) or write (0), 1 space, then
+ * the address in hex. Returns false for lines that hold no access.
+ */
+static bool parseLine(const char* line, action_s* action){
+    if (line[0] != '0' && line[0] != '1') {
+        return false;
+    }
+    action->read = (bool) (line[0] - '0');
+    action->addr = strtoul(&line[2], NULL, 16);
+    return true;
+}
+
+/*
+ * Wait for the external decompressor, if any, once nothing more will be read
+ * from it; returns false if it failed. If we stopped reading early it is
+ * terminated first, so only that SIGTERM is expected.
+ */
+static bool reapChild(traceReader* reader){
+    if (reader->child <= 0) {
+        return true;
+    }
+    if (reader->reaped) {
+        // it ran to the end of its output, so it must have succeeded
+        return WIFEXITED(reader->status) && WEXITSTATUS(reader->status) == 0;
+    }
+    kill(reader->child, SIGTERM);
+    waitpid(reader->child, &reader->status, 0);
+    reader->reaped = true;
+    return (WIFEXITED(reader->status) && WEXITSTATUS(reader->status) == 0) ||
+           (WIFSIGNALED(reader->status) && WTERMSIG(reader->status) == SIGTERM);
+}
+
+/*
+ * Producer thread: decode the input into chunks until it runs out or the
+ * simulator stops reading.
+ */
+static void* produce(void* arg){
+    traceReader* reader = arg;
+    char line[TRACE_LINE_LENGTH];
+    bool eof = false;
+
+    while (!eof) {
+        // wait for a free chunk; chunks are recycled only by the consumer
+        pthread_mutex_lock(&reader->lock);
+        while (reader->filled == TRACE_QUEUE_DEPTH && !reader->stopping) {
+            pthread_cond_wait(&reader->notFull, &reader->lock);
+        }
+        if (reader->stopping) {
+            pthread_mutex_unlock(&reader->lock);
+            break;
+        }
+        traceChunk* chunk = &reader->chunks[reader->head];
+        pthread_mutex_unlock(&reader->lock);
+
+        // decode outside the lock so the simulator keeps running
+        chunk->count = 0;
+        while (chunk->count < TRACE_CHUNK_ACTIONS) {
+            if (gzgets(reader->in, line, TRACE_LINE_LENGTH) == NULL) {
+                // a damaged gzip stream ends early too; tell it from a clean end
+                int err;
+                gzerror(reader->in, &err);
+                if (err != Z_OK && err != Z_STREAM_END) {
+                    reader->failed = true;
+                }
+                eof = true;
+                break;
+            }
+            if (parseLine(line, &chunk->actions[chunk->count])) {
+                chunk->count++;
+            }
+        }
+
+        // the decompressor has written all it will; collect its status now,
+        // before trace_close() would terminate it
+        if (eof && reader->child > 0) {
+            waitpid(reader->child, &reader->status, 0);
+            reader->reaped = true;
+        }
+
+        if (chunk->count > 0) {
+            pthread_mutex_lock(&reader->lock);
+            reader->head = (reader->head + 1) % TRACE_QUEUE_DEPTH;
+            reader->filled++;
+            pthread_cond_signal(&reader->notEmpty);
+            pthread_mutex_unlock(&reader->lock);
+        }
+    }
+
+    pthread_mutex_lock(&reader->lock);
+    reader->done = true;
+    pthread_cond_signal(&reader->notEmpty);
+    pthread_mutex_unlock(&reader->lock);
+    return NULL;
+}
+
+traceReader* trace_open(const char* fileName){
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    // sniff the magic number to pick a decoder; zlib handles plain and gzip
+    unsigned char magic[sizeof(zstdMagic)];
+    ssize_t got = read(fd, magic, sizeof(magic));
+    pid_t child = 0;
+    if (got == sizeof(magic) && memcmp(magic, zstdMagic, sizeof(magic)) == 0) {
+        close(fd);
+        fd = spawnZstd(fileName, &child);
+        if (fd < 0) {
+            return NULL;
+        }
+    } else {
+        lseek(fd, 0, SEEK_SET);
+    }
+
+    traceReader* reader = calloc(1, sizeof(traceReader));
+    if (reader == NULL) {
+        close(fd);
+        return NULL;
+    }
+    reader->child = child;
+    reader->in = gzdopen(fd, "r");
+    if (reader->in == NULL) {
+        close(fd);
+        free(reader);
+        return NULL;
+    }
+    gzbuffer(reader->in, 1 << 17);
+
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->notEmpty, NULL);
+    pthread_cond_init(&reader->notFull, NULL);
+    if (pthread_create(&reader->producer, NULL, produce, reader) != 0) {
+        gzclose(reader->in);
+        reapChild(reader);
+        pthread_mutex_destroy(&reader->lock);
+        pthread_cond_destroy(&reader->notEmpty);
+        pthread_cond_destroy(&reader->notFull);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+traceChunk* trace_next_chunk(traceReader* reader){
+    pthread_mutex_lock(&reader->lock);
+
+    // hand the chunk we were holding back to the producer
+    if (reader->holding) {
+        reader->holding = false;
+        reader->filled--;
+        pthread_cond_signal(&reader->notFull);
+    }
+
+    while (reader->filled == 0 && !reader->done) {
+        pthread_cond_wait(&reader->notEmpty, &reader->lock);
+    }
+
+    traceChunk* chunk = NULL;
+    if (reader->filled > 0) {
+        chunk = &reader->chunks[reader->tail];
+        reader->tail = (reader->tail + 1) % TRACE_QUEUE_DEPTH;
+        reader->holding = true;
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return chunk;
+}
+
+bool trace_close(traceReader* reader){
+    pthread_mutex_lock(&reader->lock);
+    reader->stopping = true;
+    pthread_cond_signal(&reader->notFull);
+    pthread_mutex_unlock(&reader->lock);
+    pthread_join(reader->producer, NULL);
+
+    gzclose(reader->in);
+    bool ok = reapChild(reader) && !reader->failed;
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->notEmpty);
+    pthread_cond_destroy(&reader->notFull);
+    free(reader);
+    return ok;
+}
@@ -0,0 +1,61 @@
+/* Streaming reader for (optionally compressed) memory traces.
+ * A producer thread decodes the trace file into fixed-size chunks of
+ * actions and hands them to the simulator through a bounded queue, so
+ * decompression and parsing overlap with the simulation itself.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "simulator.h"
+
+#define TRACE_CHUNK_ACTIONS 4096 // actions decoded per chunk
+#define TRACE_QUEUE_DEPTH   8    // chunks buffered between producer and simulator
+
+// One batch of decoded actions
+typedef struct traceChunk {
+    action_s actions[TRACE_CHUNK_ACTIONS];
+    int count;
+} traceChunk;
+
+// State shared between the producer thread and the simulator
+typedef struct traceReader {
+    gzFile          in;       // decoded stream (plain or gzip, or a zstd pipe)
+    pid_t           child;    // external decompressor, if any (0 for none)
+    bool            reaped;   // the decompressor has exited and been waited for
+    int             status;   // its wait status, once reaped
+    bool            failed;   // the input could not be decoded to its end
+    pthread_t       producer;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  notEmpty;
+    pthread_cond_t  notFull;
+    traceChunk      chunks[TRACE_QUEUE_DEPTH];
+    int             head;     // next chunk the producer fills
+    int             tail;     // next chunk the simulator consumes
+    int             filled;   // chunks queued, including one held by the simulator
+    bool            holding;  // simulator still holds chunks[tail - 1]
+    bool            done;     // producer reached end of input
+    bool            stopping; // simulator asked the producer to quit early
+} traceReader;
+
+// Open a trace file (plain text, gzip or zstd, detected by magic number)
+// and start its producer thread; returns NULL if it cannot be opened
+traceReader* trace_open(const char* fileName);
+
+// Return the next chunk of actions, blocking until one is ready; the
+// previously returned chunk is recycled. Returns NULL at end of trace.
+traceChunk* trace_next_chunk(traceReader* reader);
+
+// Stop the producer, release the input and free the reader; returns false
+// if the input could not be decoded to its end (e.g. a truncated or corrupt
+// file, or zstd is missing), in which case the actions read so far are not
+// the whole trace
+bool trace_close(traceReader* reader);
+
+#endif
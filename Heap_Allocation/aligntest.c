@@ -0,0 +1,149 @@
+// ==============================================================================
+/**
+ * aligntest.c
+ *
+ * Checks the aligned allocation functions: posix_memalign(), aligned_alloc(),
+ * memalign(), valloc() and pvalloc(), along with malloc_usable_size().  Blocks
+ * of many sizes are allocated at every alignment from 8 bytes to 1 MB, all
+ * kept live together; each must be aligned, and must hold its usable size
+ * without overlapping any other, including after some are reallocated and
+ * others freed.  Invalid alignments must be refused.  Run it with an
+ * allocator preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./aligntest
+ **/
+// ==============================================================================
+
+
+
+#define _GNU_SOURCE // for valloc() and pvalloc()
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test-util.h"
+
+/** The smallest and largest alignments tried. */
+#define MIN_ALIGNMENT 8
+#define MAX_ALIGNMENT (1024 * 1024)
+
+/** The number of alignments tried, one per power of two. */
+#define NUM_ALIGNMENTS 18
+
+/** The sizes requested, covering slab slots, heap blocks, and mappings. */
+static const size_t sizes[] = { 1, 7, 16, 48, 100, 256, 300, 1000, 5000, 70000, 200000 };
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/** The number of blocks allocated at each alignment: one per size and function. */
+#define BLOCKS_PER_ALIGNMENT (3 * NUM_SIZES)
+
+/** A block allocated by the test, and the byte it is filled with. */
+typedef struct test_block {
+  unsigned char* ptr;
+  size_t         size;
+  unsigned char  fill;
+} test_block_s;
+
+static test_block_s blocks[NUM_ALIGNMENTS * BLOCKS_PER_ALIGNMENT];
+
+/** Check a new block's alignment and usable size, then fill it. */
+static int fill_block (test_block_s* block, void* ptr, size_t alignment, size_t size, unsigned char fill) {
+
+  if (!check(ptr != NULL, "aligned allocation returned NULL") ||
+      !check((uintptr_t)ptr % alignment == 0, "block is not aligned") ||
+      !check(malloc_usable_size(ptr) >= size, "usable size is less than requested")) {
+    return 0;
+  }
+  block->ptr  = ptr;
+  block->size = malloc_usable_size(ptr);
+  block->fill = fill;
+  memset(ptr, fill, block->size);
+  return 1;
+
+}
+
+/** Check that a block still holds its fill. */
+static int check_block (test_block_s* block) {
+
+  for (size_t i = 0; i < block->size; i++) {
+    if (block->ptr[i] != block->fill) {
+      return check(0, "block contents overwritten");
+    }
+  }
+  return 1;
+
+}
+
+int main () {
+
+  int    pass  = 1;
+  int    count = 0;
+  size_t page  = sysconf(_SC_PAGESIZE);
+
+  // Every alignment, size, and function, all live at once.
+  for (size_t alignment = MIN_ALIGNMENT; alignment <= MAX_ALIGNMENT && pass; alignment *= 2) {
+    for (size_t i = 0; i < NUM_SIZES && pass; i++) {
+      void* ptr = NULL;
+      pass &= check(posix_memalign(&ptr, alignment, sizes[i]) == 0, "posix_memalign() failed");
+      pass &= fill_block(&blocks[count], ptr, alignment, sizes[i], (unsigned char)count);
+      count++;
+      pass &= fill_block(&blocks[count], aligned_alloc(alignment, sizes[i]), alignment, sizes[i],
+                         (unsigned char)count);
+      count++;
+      pass &= fill_block(&blocks[count], memalign(alignment, sizes[i]), alignment, sizes[i],
+                         (unsigned char)count);
+      count++;
+    }
+  }
+  for (int i = 0; i < count && pass; i++) {
+    pass &= check_block(&blocks[i]);
+  }
+
+  // Grow every third block, and free every other one, then check the rest.
+  for (int i = 0; i < count && pass; i += 3) {
+    size_t         size = blocks[i].size;
+    unsigned char* ptr  = realloc(blocks[i].ptr, size * 2);
+    if (!check(ptr != NULL, "realloc() returned NULL")) {
+      pass = 0;
+      break;
+    }
+    blocks[i].ptr = ptr;
+    pass &= check_block(&blocks[i]);
+    memset(ptr + size, blocks[i].fill, size);
+    blocks[i].size = size * 2;
+  }
+  for (int i = 1; i < count; i += 2) {
+    free(blocks[i].ptr);
+  }
+  for (int i = 0; i < count && pass; i += 2) {
+    pass &= check_block(&blocks[i]);
+    free(blocks[i].ptr);
+  }
+
+  // Page-aligned allocations, and pvalloc()'s rounding to whole pages.
+  void* ptr = valloc(100);
+  pass &= check(ptr != NULL && (uintptr_t)ptr % page == 0, "valloc() block is not page-aligned");
+  free(ptr);
+  ptr = pvalloc(page + 1);
+  pass &= check(ptr != NULL && (uintptr_t)ptr % page == 0, "pvalloc() block is not page-aligned");
+  pass &= check(ptr != NULL && malloc_usable_size(ptr) >= 2 * page, "pvalloc() did not round up");
+  free(ptr);
+
+  // A non-power-of-two alignment is rounded up by memalign() alone.
+  ptr = memalign(48, 100);
+  pass &= check(ptr != NULL && (uintptr_t)ptr % 64 == 0, "memalign(48) block is not 64-byte aligned");
+  free(ptr);
+  pass &= check(posix_memalign(&ptr, 4, 100) == EINVAL, "posix_memalign(4) was not refused");
+  pass &= check(posix_memalign(&ptr, 24, 100) == EINVAL, "posix_memalign(24) was not refused");
+  errno = 0;
+  pass &= check(aligned_alloc(24, 100) == NULL && errno == EINVAL, "aligned_alloc(24) was not refused");
+  pass &= check(malloc_usable_size(NULL) == 0, "malloc_usable_size(NULL) is not 0");
+
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+
+}
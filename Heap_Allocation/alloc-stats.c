@@ -0,0 +1,96 @@
+// ==============================================================================
+/**
+ * alloc-stats.c
+ *
+ * The parts of the allocators' statistics shared by both: totalling and
+ * printing a snapshot.  Nothing here allocates.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdint.h>
+#include <string.h>
+
+#include "alloc-stats.h"
+#include "safeio.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Fill in the totals of a snapshot from its classes.
+ *
+ * \param stats The snapshot, whose classes are filled in.
+ */
+void alloc_stats_total (alloc_stats_s* stats) {
+
+  stats->bytes_in_use = 0;
+  stats->bytes_free   = 0;
+  stats->free_blocks  = 0;
+  for (int class = 0; class < stats->num_classes; class++) {
+    stats->bytes_in_use += stats->classes[class].bytes_in_use;
+    stats->bytes_free   += stats->classes[class].bytes_free;
+    stats->free_blocks  += stats->classes[class].free_blocks;
+  }
+
+  size_t heap_bytes        = stats->bytes_in_use + stats->bytes_free;
+  stats->probes_per_malloc = (stats->searches == 0) ? 0.0 : (double)stats->probes / stats->searches;
+  stats->fragmentation     = (heap_bytes == 0) ? 0.0 : (double)stats->bytes_free / heap_bytes;
+
+} // alloc_stats_total ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print a snapshot of an allocator's statistics to `stderr`: the totals, then
+ * a line for each size class that has any blocks.  Ratios are printed in
+ * thousandths, since only integers can be printed without allocating.
+ *
+ * \param name  The name of the allocator.
+ * \param stats The snapshot to print.
+ */
+void alloc_stats_print (const char* name, const alloc_stats_s* stats) {
+
+  PRINT(name);
+  PRINT("  bytes in use:             ", (uint64_t)stats->bytes_in_use);
+  PRINT("  bytes free:               ", (uint64_t)stats->bytes_free);
+  PRINT("  free blocks:              ", (uint64_t)stats->free_blocks);
+  PRINT("  bytes mmapped:            ", (uint64_t)stats->mmapped_bytes);
+  PRINT("  peak bytes:               ", (uint64_t)stats->peak_bytes);
+  PRINT("  heap high-water mark:     ", (uint64_t)stats->high_water);
+  if (stats->fit_policy != NULL) {
+    char line[64] = "  fit policy:               ";
+    strncat(line, stats->fit_policy, sizeof(line) - strlen(line) - 1);
+    if (stats->fit_candidates != 0) {
+      PRINT(line, (uint64_t)stats->fit_candidates);
+    } else {
+      PRINT(line);
+    }
+  }
+  PRINT("  free-list searches:       ", (uint64_t)stats->searches);
+  PRINT("  probes per 1000 searches: ", (uint64_t)(stats->probes_per_malloc * 1000));
+  PRINT("  fragmentation (per 1000): ", (uint64_t)(stats->fragmentation * 1000));
+  PRINT("  class\tmin size\tblocks in use\tbytes in use\tfree blocks\tbytes free");
+
+  for (int class = 0; class < stats->num_classes; class++) {
+    const alloc_class_stats_s* counts = &stats->classes[class];
+    if (counts->blocks_in_use != 0 || counts->free_blocks != 0) {
+      PRINT("  ",
+            (uint64_t)class,
+            (uint64_t)counts->min_size,
+            (uint64_t)counts->blocks_in_use,
+            (uint64_t)counts->bytes_in_use,
+            (uint64_t)counts->free_blocks,
+            (uint64_t)counts->bytes_free);
+    }
+  }
+
+} // alloc_stats_print ()
+// ==============================================================================
@@ -0,0 +1,157 @@
+// ==============================================================================
+/**
+ * alloc-stats.h
+ *
+ * Statistics kept by the allocators, and the functions that report them.
+ * Each allocator keeps its counters as it goes, so that gathering them never
+ * allocates; a program run with an allocator preloaded can query them with
+ * `alloc_stats()`, or print them to `stderr` with `malloc_stats()`.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_ALLOC_STATS_H)
+#define _ALLOC_STATS_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stddef.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** The most size classes that any allocator reports. */
+#define ALLOC_STATS_MAX_CLASSES 72
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND STRUCTURES
+
+/** The counters for one size class.  Sizes include the blocks' headers. */
+typedef struct alloc_class_stats {
+
+  /** The smallest block size in the class. */
+  size_t min_size;
+
+  /** The number of blocks in use. */
+  size_t blocks_in_use;
+
+  /** The bytes in those blocks. */
+  size_t bytes_in_use;
+
+  /** The number of free blocks. */
+  size_t free_blocks;
+
+  /** The bytes in those blocks. */
+  size_t bytes_free;
+
+} alloc_class_stats_s;
+
+/**
+ * A snapshot of an allocator's statistics.  Byte counts cover the heap
+ * (blocks and slots); individually mapped blocks are only counted in
+ * `mmapped_bytes`.
+ */
+typedef struct alloc_stats {
+
+  /** The bytes in blocks in use, headers included. */
+  size_t              bytes_in_use;
+
+  /** The bytes in free blocks. */
+  size_t              bytes_free;
+
+  /** The number of free blocks. */
+  size_t              free_blocks;
+
+  /** The bytes in individually mapped blocks. */
+  size_t              mmapped_bytes;
+
+  /**
+   * The peak of `bytes_in_use + mmapped_bytes`.  Where the heap is split into
+   * arenas, or counted by thread, this is the sum of their peaks, so may
+   * exceed the true peak.
+   */
+  size_t              peak_bytes;
+
+  /** The most of the heap region that the bump pointer has ever covered. */
+  size_t              high_water;
+
+  /**
+   * The policy that picks among the free blocks that fit, or `NULL` if the
+   * allocator never searches them.
+   */
+  const char*         fit_policy;
+
+  /** The candidates the policy considers, if it has such a limit; else 0. */
+  size_t              fit_candidates;
+
+  /** The allocations that searched the free blocks. */
+  size_t              searches;
+
+  /** The free blocks examined by those searches. */
+  size_t              probes;
+
+  /** `probes / searches`. */
+  double              probes_per_malloc;
+
+  /** The fraction of the heap's blocks that is free. */
+  double              fragmentation;
+
+  /** The number of entries in `classes`. */
+  int                 num_classes;
+
+  /** The counters for each size class, smallest first. */
+  alloc_class_stats_s classes[ALLOC_STATS_MAX_CLASSES];
+
+} alloc_stats_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take a snapshot of the allocator's statistics.
+ *
+ * \param stats The structure to fill.
+ */
+void alloc_stats (alloc_stats_s* stats);
+
+/** Print the allocator's statistics to `stderr`. */
+void malloc_stats (void);
+
+/**
+ * Fill in the totals of a snapshot from its classes.  For the allocators' use.
+ *
+ * \param stats The snapshot, whose classes are filled in.
+ */
+void alloc_stats_total (alloc_stats_s* stats);
+
+/**
+ * Print a snapshot of an allocator's statistics to `stderr` without
+ * allocating, so that it is safe from a signal handler.  For the allocators'
+ * use.
+ *
+ * \param name  The name of the allocator.
+ * \param stats The snapshot to print.
+ */
+void alloc_stats_print (const char* name, const alloc_stats_s* stats);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _ALLOC_STATS_H
+// ==============================================================================
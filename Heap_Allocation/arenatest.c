@@ -0,0 +1,121 @@
+// ==============================================================================
+/**
+ * arenatest.c
+ *
+ * Checks the arenas of `pb-alloc.h`.  Two arenas are filled in turn, as two
+ * request handlers would fill theirs, with blocks both smaller and larger than
+ * a chunk; each block's contents are checked before its arena is released.
+ * Releasing to a mark must hand the same memory out again, and resetting an
+ * arena must not take any more memory from the heap.  It is linked against
+ * `libpb.so`, so needs no preloading:
+ *
+ *   ./arenatest
+ **/
+// ==============================================================================
+
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-stats.h"
+#include "pb-alloc.h"
+#include "test-util.h"
+
+/** The number of blocks allocated from each arena per round. */
+#define BLOCKS_PER_ROUND 1000
+
+/** The number of rounds. */
+#define ROUNDS           50
+
+/** The largest block size requested; larger than an arena's first chunk. */
+#define MAX_BLOCK_SIZE   (96 * 1024)
+
+static unsigned char* blocks[2][BLOCKS_PER_ROUND];
+static size_t         sizes[2][BLOCKS_PER_ROUND];
+
+/** Allocate a round of blocks from an arena, filling each with `fill`. */
+static int fill_round (pb_arena_s* arena, int which, unsigned int* seed, unsigned char fill) {
+
+  for (int i = 0; i < BLOCKS_PER_ROUND; i++) {
+    size_t size = 1 + rand_r(seed) % ((i % 100 == 0) ? MAX_BLOCK_SIZE : 256);
+    unsigned char* block = pb_arena_alloc(arena, size);
+    if (!check(block != NULL, "pb_arena_alloc() returned NULL") ||
+        !check((intptr_t)block % 16 == 0, "block is not 16-byte aligned")) {
+      return 0;
+    }
+    memset(block, fill, size);
+    blocks[which][i] = block;
+    sizes[which][i]  = size;
+  }
+  return 1;
+
+}
+
+/** Check that every block of a round still holds `fill`. */
+static int check_round (int which, unsigned char fill) {
+
+  for (int i = 0; i < BLOCKS_PER_ROUND; i++) {
+    for (size_t j = 0; j < sizes[which][i]; j++) {
+      if (blocks[which][i][j] != fill) {
+        return check(0, "block contents overwritten");
+      }
+    }
+  }
+  return 1;
+
+}
+
+int main () {
+
+  int          pass = 1;
+  unsigned int seed = 1;
+
+  pb_arena_s* arenas[2] = { pb_arena_create(), pb_arena_create() };
+  if (!check(arenas[0] != NULL && arenas[1] != NULL, "pb_arena_create() returned NULL")) {
+    return 1;
+  }
+  pass &= check(pb_arena_alloc(arenas[0], 0) == NULL, "pb_arena_alloc(0) is not NULL");
+
+  // Blocks allocated before a mark survive releasing to it, and the memory
+  // after it is handed out again.
+  void*     kept  = pb_arena_alloc(arenas[0], 100);
+  memset(kept, 7, 100);
+  pb_mark_s mark  = pb_arena_mark(arenas[0]);
+  void*     first = pb_arena_alloc(arenas[0], 100);
+  pb_arena_release(arenas[0], mark);
+  pass &= check(pb_arena_alloc(arenas[0], 100) == first, "release did not reuse the memory");
+  pb_arena_release(arenas[0], mark);
+  pass &= check(((unsigned char*)kept)[99] == 7, "release freed a block before the mark");
+
+  // Rounds of interleaved use; the first round takes the arenas' chunks, and
+  // the same requests again should need nothing more from the heap.
+  size_t heap_bytes = 0;
+  for (int round = 0; round < ROUNDS && pass; round++) {
+    mark  = pb_arena_mark(arenas[0]);
+    pass &= fill_round(arenas[0], 0, &seed, (unsigned char)round);
+    pass &= fill_round(arenas[1], 1, &seed, (unsigned char)~round);
+    pass &= check_round(0, (unsigned char)round) && check_round(1, (unsigned char)~round);
+    pb_arena_release(arenas[0], mark);
+    pb_arena_reset(arenas[1]);
+    seed = 1;
+
+    alloc_stats_s stats;
+    alloc_stats(&stats);
+    if (round == 0) {
+      heap_bytes = stats.bytes_in_use + stats.mmapped_bytes;
+    } else {
+      pass &= check(stats.bytes_in_use + stats.mmapped_bytes == heap_bytes,
+                    "released arenas took more memory from the heap");
+    }
+  }
+
+  pb_arena_destroy(arenas[0]);
+  pb_arena_destroy(arenas[1]);
+
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+
+}
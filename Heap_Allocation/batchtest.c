@@ -0,0 +1,144 @@
+// ==============================================================================
+/**
+ * batchtest.c
+ *
+ * Checks the batch calls of `bf-alloc.h`.  Batches of slab slots, heap blocks,
+ * and individually mapped blocks are allocated, filled, and checked, then
+ * freed: half by this thread, and half by another thread, which (with more
+ * than one arena) hands them back through their arena's remote-free list.
+ * Once all are freed, repeating the rounds must neither leave more bytes
+ * counted in use nor need any more of the heap.  The sized frees are tried
+ * along the way, and freeing a slot or block twice, while the first free
+ * still sits in the tcache, must be caught.  It is linked against
+ * `libbf.so`, so needs no preloading:
+ *
+ *   BF_ARENAS=2 ./batchtest
+ **/
+// ==============================================================================
+
+
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "alloc-stats.h"
+#include "bf-alloc.h"
+#include "test-util.h"
+
+/** The number of blocks in each batch. */
+#define BATCH_SIZE 500
+
+/** The number of rounds. */
+#define ROUNDS     20
+
+/** The sizes batched, covering slab slots, heap blocks, and mappings. */
+static const size_t sizes[] = { 8, 64, 256, 300, 1000, 5000, 200000 };
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static void* blocks[BATCH_SIZE];
+
+/** Free the second half of the batch, from a thread of its own. */
+static void* free_half (void* unused) {
+
+  free_batch(blocks + BATCH_SIZE / 2, BATCH_SIZE - BATCH_SIZE / 2);
+  return NULL;
+
+}
+
+/**
+ * Is freeing a block of `size` bytes twice caught?  Tried in a child, since
+ * the allocator exits on the error.
+ */
+static int double_free_caught (size_t size) {
+
+  pid_t child = fork();
+  if (child == 0) {
+    dup2(open("/dev/null", O_WRONLY), STDERR_FILENO); // the expected error
+    void* volatile block = malloc(size);               // hidden from the compiler
+    free(block);
+    free(block);
+    _exit(0);
+  }
+  int status;
+  waitpid(child, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 1;
+
+}
+
+/** The bytes counted in use, including those mapped for blocks of their own. */
+static size_t bytes_in_use () {
+
+  alloc_stats_s stats;
+  alloc_stats(&stats);
+  return stats.bytes_in_use + stats.mmapped_bytes;
+
+}
+
+int main () {
+
+  int    pass   = 1;
+  size_t in_use = 0;
+  size_t heap   = 0;
+
+  for (int round = 0; round < ROUNDS && pass; round++) {
+    for (size_t i = 0; i < NUM_SIZES && pass; i++) {
+
+      size_t size = sizes[i];
+      pass &= check(malloc_batch(size, BATCH_SIZE, blocks) == BATCH_SIZE,
+                    "malloc_batch() allocated too few blocks");
+      for (int j = 0; j < BATCH_SIZE && pass; j++) {
+        pass &= check(blocks[j] != NULL && (uintptr_t)blocks[j] % 16 == 0,
+                      "batched block is NULL or not 16-byte aligned");
+        memset(blocks[j], (unsigned char)j, size);
+      }
+      for (int j = 0; j < BATCH_SIZE && pass; j++) {
+        for (size_t k = 0; k < size; k += 7) {
+          if (((unsigned char*)blocks[j])[k] != (unsigned char)j) {
+            pass = check(0, "batched blocks overlap");
+            break;
+          }
+        }
+      }
+      if (!pass) {
+        break;
+      }
+
+      pthread_t thread;
+      pthread_create(&thread, NULL, free_half, NULL);
+      free_batch(blocks, BATCH_SIZE / 2);
+      pthread_join(thread, NULL);
+
+      void* block = malloc(size);
+      free_sized(block, size);
+
+    }
+
+    // The second thread's frees may still be waiting on a remote-free list,
+    // which a batch from the same arena takes back first.
+    free_batch(blocks, malloc_batch(1000, 1, blocks));
+
+    alloc_stats_s stats;
+    alloc_stats(&stats);
+    if (round == 0) {
+      in_use = bytes_in_use();
+      heap   = stats.high_water;
+    } else {
+      pass &= check(bytes_in_use() == in_use, "freed batches are still counted in use");
+      pass &= check(stats.high_water == heap, "repeated batches took more of the heap");
+    }
+  }
+
+  pass &= check(double_free_caught(24), "double free of a small slot not caught");
+  pass &= check(double_free_caught(200), "double free of a large slot not caught");
+  pass &= check(double_free_caught(1000), "double free of a block not caught");
+
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+
+}
@@ -0,0 +1,96 @@
+// ==============================================================================
+/**
+ * bench-alloc.c
+ *
+ * A thread-scaling benchmark for allocation alone.  For 1, 2, 4, ... up to the
+ * given number of threads, each thread allocates small blocks, writing to
+ * each, and frees none of them until all the threads are done; this is the
+ * pattern that a bump allocator's per-thread buffers are meant to make scale.
+ * Only the allocations are timed.  The total throughput for each thread count
+ * is printed as CSV.  Run it with an allocator preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libpb.so ./bench-alloc [max threads] [ops per thread]
+ **/
+// ==============================================================================
+
+
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test-util.h"
+
+/** The largest block size requested. */
+#define MAX_BENCH_SIZE 128
+
+static long ops_per_thread;
+
+/** Lines the threads and the timer up at the start and end of the allocations. */
+static pthread_barrier_t start_line, finish_line;
+
+/** One thread's share of the work: allocate its blocks, then free them all. */
+static void* worker (void* arg) {
+
+  unsigned int seed   = (unsigned int)(intptr_t)arg;
+  char**       blocks = malloc(ops_per_thread * sizeof(char*));
+  if (blocks == NULL) {
+    fprintf(stderr, "malloc failed\n");
+    exit(1);
+  }
+
+  pthread_barrier_wait(&start_line);
+  for (long i = 0; i < ops_per_thread; i++) {
+    blocks[i] = malloc(16 + rand_r(&seed) % (MAX_BENCH_SIZE - 16));
+    if (blocks[i] == NULL) {
+      fprintf(stderr, "malloc failed\n");
+      exit(1);
+    }
+    blocks[i][0] = (char)i;
+  }
+  pthread_barrier_wait(&finish_line);
+
+  for (long i = 0; i < ops_per_thread; i++) {
+    free(blocks[i]);
+  }
+  free(blocks);
+  return NULL;
+
+}
+
+int main (int argc, char **argv) {
+
+  int max_threads = (argc > 1) ? atoi(argv[1]) : 16;
+  ops_per_thread  = (argc > 2) ? atol(argv[2]) : 100000;
+
+  pthread_t* threads = malloc(max_threads * sizeof(pthread_t));
+  printf("threads,ops,seconds,ops_per_sec\n");
+
+  for (int count = 1; count <= max_threads; count *= 2) {
+
+    pthread_barrier_init(&start_line, NULL, count + 1);
+    pthread_barrier_init(&finish_line, NULL, count + 1);
+    for (int t = 0; t < count; t++) {
+      pthread_create(&threads[t], NULL, worker, (void*)(intptr_t)(t + 1));
+    }
+    pthread_barrier_wait(&start_line);
+    double start = now();
+    pthread_barrier_wait(&finish_line);
+    double elapsed = now() - start;
+    for (int t = 0; t < count; t++) {
+      pthread_join(threads[t], NULL);
+    }
+    pthread_barrier_destroy(&start_line);
+    pthread_barrier_destroy(&finish_line);
+
+    long ops = ops_per_thread * count;
+    printf("%d,%ld,%.3f,%.0f\n", count, ops, elapsed, ops / elapsed);
+    fflush(stdout);
+
+  }
+
+  free(threads);
+  return 0;
+
+}
@@ -0,0 +1,94 @@
+// ==============================================================================
+/**
+ * bench-larson.c
+ *
+ * A Larson-style server benchmark.  Each thread owns a set of live blocks of
+ * random sizes and repeatedly replaces random members of it, as a server
+ * handling requests would.  After each round the threads exit and a fresh
+ * set of threads takes over their blocks, so most blocks are freed by a
+ * different thread from the one that allocated them.  Prints one line of CSV.
+ * Run it with an allocator preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./bench-larson [threads] [rounds] [ops per thread per round]
+ **/
+// ==============================================================================
+
+
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test-util.h"
+
+/** The number of live blocks each thread owns. */
+#define BLOCKS_PER_THREAD 1000
+
+/** The range of block sizes requested. */
+#define MIN_BENCH_SIZE    16
+#define MAX_BENCH_SIZE    512
+
+/** One thread's blocks, handed from round to round. */
+typedef struct block_set {
+  char*        blocks[BLOCKS_PER_THREAD];
+  unsigned int seed;
+} block_set_s;
+
+static long ops_per_round;
+
+/** One round of one thread's work: replace random members of its set. */
+static void* worker (void* arg) {
+
+  block_set_s* set = arg;
+  for (long i = 0; i < ops_per_round; i++) {
+    int victim = rand_r(&set->seed) % BLOCKS_PER_THREAD;
+    free(set->blocks[victim]);
+    set->blocks[victim] = malloc(MIN_BENCH_SIZE + rand_r(&set->seed) % (MAX_BENCH_SIZE - MIN_BENCH_SIZE));
+    if (set->blocks[victim] == NULL) {
+      fprintf(stderr, "malloc failed\n");
+      exit(1);
+    }
+    set->blocks[victim][0] = (char)i;
+  }
+  return NULL;
+
+}
+
+int main (int argc, char **argv) {
+
+  int threads   = (argc > 1) ? atoi(argv[1]) : 4;
+  int rounds    = (argc > 2) ? atoi(argv[2]) : 20;
+  ops_per_round = (argc > 3) ? atol(argv[3]) : 100000;
+
+  block_set_s* sets    = calloc(threads, sizeof(block_set_s));
+  pthread_t*   workers = malloc(threads * sizeof(pthread_t));
+  for (int t = 0; t < threads; t++) {
+    sets[t].seed = t + 1;
+  }
+
+  double start = now();
+  for (int round = 0; round < rounds; round++) {
+    for (int t = 0; t < threads; t++) {
+      pthread_create(&workers[t], NULL, worker, &sets[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+      pthread_join(workers[t], NULL);
+    }
+  }
+  double elapsed = now() - start;
+
+  for (int t = 0; t < threads; t++) {
+    for (int i = 0; i < BLOCKS_PER_THREAD; i++) {
+      free(sets[t].blocks[i]);
+    }
+  }
+
+  // Count each replacement's free() and malloc() as an operation each.
+  long ops = 2 * ops_per_round * threads * rounds;
+  bench_report("larson", threads, ops, elapsed);
+  free(workers);
+  free(sets);
+  return 0;
+
+}
@@ -0,0 +1,86 @@
+// ==============================================================================
+/**
+ * bench-random.c
+ *
+ * A random fill/free benchmark.  Fills a set of blocks of random sizes, from
+ * tiny to tens of kilobytes, then repeatedly frees a random half of them and
+ * fills the holes again with blocks of new random sizes, leaving the heap
+ * well fragmented.  Prints one line of CSV.  Run it with an allocator
+ * preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./bench-random [blocks] [rounds]
+ **/
+// ==============================================================================
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test-util.h"
+
+/** The range of block sizes requested. */
+#define MIN_BENCH_SIZE 16
+#define MAX_BENCH_SIZE 65536
+
+/** Pick a block size, smaller sizes being likelier. */
+static size_t random_size (unsigned int* seed) {
+
+  size_t limit = MIN_BENCH_SIZE << (rand_r(seed) % 13); // 16 B to 64 KB
+  return MIN_BENCH_SIZE + rand_r(seed) % (limit - MIN_BENCH_SIZE + 1);
+
+}
+
+/** Allocate and touch a block, or give up. */
+static char* checked_malloc (size_t size) {
+
+  char* block = malloc(size);
+  if (block == NULL) {
+    fprintf(stderr, "malloc(%zu) failed\n", size);
+    exit(1);
+  }
+  memset(block, 1, (size < 64) ? size : 64);
+  return block;
+
+}
+
+int main (int argc, char **argv) {
+
+  int          count  = (argc > 1) ? atoi(argv[1]) : 20000;
+  int          rounds = (argc > 2) ? atoi(argv[2]) : 50;
+  unsigned int seed   = 171;
+  char**       blocks = calloc(count, sizeof(char*));
+  long         ops    = 0;
+
+  double start = now();
+  for (int i = 0; i < count; i++) {
+    blocks[i] = checked_malloc(random_size(&seed));
+    ops++;
+  }
+  for (int round = 0; round < rounds; round++) {
+    for (int i = 0; i < count; i++) {
+      if (rand_r(&seed) % 2 == 0) {
+        free(blocks[i]);
+        blocks[i] = NULL;
+        ops++;
+      }
+    }
+    for (int i = 0; i < count; i++) {
+      if (blocks[i] == NULL) {
+        blocks[i] = checked_malloc(random_size(&seed));
+        ops++;
+      }
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    free(blocks[i]);
+    ops++;
+  }
+  double elapsed = now() - start;
+
+  bench_report("random", 1, ops, elapsed);
+  free(blocks);
+  return 0;
+
+}
@@ -0,0 +1,78 @@
+// ==============================================================================
+/**
+ * bench-realloc.c
+ *
+ * A sequential growth benchmark.  Builds many buffers at once, appending a
+ * few bytes at a time to each in turn and growing it with realloc() whenever
+ * it is full, by a fixed step as a naive string builder would.  Prints one
+ * line of CSV.  Run it with an allocator preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./bench-realloc [buffers] [final size] [rounds]
+ **/
+// ==============================================================================
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test-util.h"
+
+/** The bytes appended to a buffer at a time. */
+#define APPEND_SIZE 16
+
+/** The bytes a full buffer grows by. */
+#define GROWTH_STEP 256
+
+int main (int argc, char **argv) {
+
+  int     count      = (argc > 1) ? atoi(argv[1]) : 16;
+  size_t  final_size = (argc > 2) ? (size_t)atol(argv[2]) : 1024 * 1024;
+  int     rounds     = (argc > 3) ? atoi(argv[3]) : 5;
+  char**  buffers    = malloc(count * sizeof(char*));
+  size_t* capacities = malloc(count * sizeof(size_t));
+  long    ops        = 0;
+
+  double start = now();
+  for (int round = 0; round < rounds; round++) {
+
+    for (int i = 0; i < count; i++) {
+      buffers[i]    = NULL;
+      capacities[i] = 0;
+    }
+
+    for (size_t length = 0; length < final_size; length += APPEND_SIZE) {
+      for (int i = 0; i < count; i++) {
+        if (length + APPEND_SIZE > capacities[i]) {
+          capacities[i] += GROWTH_STEP;
+          buffers[i]     = realloc(buffers[i], capacities[i]);
+          if (buffers[i] == NULL) {
+            fprintf(stderr, "realloc(%zu) failed\n", capacities[i]);
+            return 1;
+          }
+          ops++;
+        }
+        memset(buffers[i] + length, (char)i, APPEND_SIZE);
+      }
+    }
+
+    // Check the contents survived every move.
+    for (int i = 0; i < count; i++) {
+      if (buffers[i][0] != (char)i || buffers[i][final_size - 1] != (char)i) {
+        fprintf(stderr, "buffer %d corrupted\n", i);
+        return 1;
+      }
+      free(buffers[i]);
+      ops++;
+    }
+
+  }
+  double elapsed = now() - start;
+
+  bench_report("realloc", 1, ops, elapsed);
+  free(capacities);
+  free(buffers);
+  return 0;
+
+}
@@ -0,0 +1,84 @@
+// ==============================================================================
+/**
+ * bench-threads.c
+ *
+ * A thread-scaling benchmark for small allocations.  For 1, 2, 4, ... up to
+ * the given number of threads, each thread repeatedly frees one of its recent
+ * blocks and allocates a new small one in its place.  The total throughput
+ * for each thread count is printed as CSV.  Run it with an allocator
+ * preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./bench-threads [max threads] [ops per thread]
+ **/
+// ==============================================================================
+
+
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test-util.h"
+
+/** The number of recent blocks each thread keeps live. */
+#define LIVE_PER_THREAD 64
+
+/** The largest block size requested. */
+#define MAX_BENCH_SIZE  256
+
+static long ops_per_thread;
+
+/** One thread's share of the work: replace its live blocks over and over. */
+static void* worker (void* arg) {
+
+  unsigned int seed = (unsigned int)(intptr_t)arg;
+  char*        live[LIVE_PER_THREAD] = { NULL };
+
+  for (long i = 0; i < ops_per_thread; i++) {
+    int slot = i % LIVE_PER_THREAD;
+    free(live[slot]);
+    live[slot] = malloc(16 + rand_r(&seed) % (MAX_BENCH_SIZE - 16));
+    if (live[slot] == NULL) {
+      fprintf(stderr, "malloc failed\n");
+      exit(1);
+    }
+    live[slot][0] = (char)i;
+  }
+
+  for (int slot = 0; slot < LIVE_PER_THREAD; slot++) {
+    free(live[slot]);
+  }
+  return NULL;
+
+}
+
+int main (int argc, char **argv) {
+
+  int max_threads = (argc > 1) ? atoi(argv[1]) : 64;
+  ops_per_thread  = (argc > 2) ? atol(argv[2]) : 1000000;
+
+  pthread_t* threads = malloc(max_threads * sizeof(pthread_t));
+  printf("threads,ops,seconds,ops_per_sec\n");
+
+  for (int count = 1; count <= max_threads; count *= 2) {
+
+    double start = now();
+    for (int t = 0; t < count; t++) {
+      pthread_create(&threads[t], NULL, worker, (void*)(intptr_t)(t + 1));
+    }
+    for (int t = 0; t < count; t++) {
+      pthread_join(threads[t], NULL);
+    }
+    double elapsed = now() - start;
+
+    long ops = ops_per_thread * count;
+    printf("%d,%ld,%.3f,%.0f\n", count, ops, elapsed, ops / elapsed);
+    fflush(stdout);
+
+  }
+
+  free(threads);
+  return 0;
+
+}
@@ -0,0 +1,72 @@
+// ==============================================================================
+/**
+ * bench-tiny.c
+ *
+ * A many-tiny-objects benchmark.  Builds a large linked list of 8- to 32-byte
+ * nodes, walks it, and frees it, over and over.  Per-block overhead shows up
+ * directly in the peak RSS.  Prints one line of CSV.  Run it with an allocator preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./bench-tiny [objects] [rounds]
+ **/
+// ==============================================================================
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test-util.h"
+
+/** The range of object sizes requested. */
+#define MIN_BENCH_SIZE 8
+#define MAX_BENCH_SIZE 32
+
+/** A list node; the smallest objects hold just the link. */
+typedef struct node {
+  struct node* next;
+} node_s;
+
+int main (int argc, char **argv) {
+
+  long         count  = (argc > 1) ? atol(argv[1]) : 1000000;
+  int          rounds = (argc > 2) ? atoi(argv[2]) : 10;
+  unsigned int seed   = 171;
+  long         ops    = 0;
+
+  double start = now();
+  for (int round = 0; round < rounds; round++) {
+
+    node_s* head = NULL;
+    for (long i = 0; i < count; i++) {
+      node_s* node = malloc(MIN_BENCH_SIZE + rand_r(&seed) % (MAX_BENCH_SIZE - MIN_BENCH_SIZE + 1));
+      if (node == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return 1;
+      }
+      node->next = head;
+      head       = node;
+    }
+
+    long length = 0;
+    for (node_s* node = head; node != NULL; node = node->next) {
+      length++;
+    }
+    if (length != count) {
+      fprintf(stderr, "list corrupted\n");
+      return 1;
+    }
+
+    while (head != NULL) {
+      node_s* next = head->next;
+      free(head);
+      head = next;
+    }
+    ops += 2 * count;
+
+  }
+  double elapsed = now() - start;
+
+  bench_report("tiny", 1, ops, elapsed);
+  return 0;
+
+}
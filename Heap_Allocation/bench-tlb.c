@@ -0,0 +1,83 @@
+// ==============================================================================
+/**
+ * bench-tlb.c
+ *
+ * A TLB-bound benchmark.  Allocates a large heap of small objects, links them
+ * into one cycle in random order, and chases the pointers around it, so that
+ * nearly every hop lands on a different page.  With 4 KB pages most hops miss
+ * the TLB; with the heap on huge pages far fewer do, so comparing a run with
+ * and without an allocator's huge-page mode shows what the mode buys.  Only
+ * the pointer chasing is timed.  Prints one line of CSV.  Run it with an
+ * allocator preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./bench-tlb [objects] [hops]
+ *   BF_HUGEPAGES=1 LD_PRELOAD=./libbf.so ./bench-tlb [objects] [hops]
+ **/
+// ==============================================================================
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test-util.h"
+
+/** The range of object sizes requested. */
+#define MIN_BENCH_SIZE 48
+#define MAX_BENCH_SIZE 256
+
+/** An object; the rest of it is padding. */
+typedef struct node {
+  struct node* next;
+} node_s;
+
+int main (int argc, char **argv) {
+
+  long         count = (argc > 1) ? atol(argv[1]) : 1000000;
+  long         hops  = (argc > 2) ? atol(argv[2]) : 20000000;
+  unsigned int seed  = 171;
+
+  node_s** nodes = malloc(count * sizeof(node_s*));
+  if (nodes == NULL) {
+    fprintf(stderr, "malloc failed\n");
+    return 1;
+  }
+  for (long i = 0; i < count; i++) {
+    nodes[i] = malloc(MIN_BENCH_SIZE + rand_r(&seed) % (MAX_BENCH_SIZE - MIN_BENCH_SIZE + 1));
+    if (nodes[i] == NULL) {
+      fprintf(stderr, "malloc failed\n");
+      return 1;
+    }
+  }
+
+  // Shuffle the objects, then link them into a cycle in that order.
+  for (long i = count - 1; i > 0; i--) {
+    long    j    = ((long)rand_r(&seed) * RAND_MAX + rand_r(&seed)) % (i + 1);
+    node_s* swap = nodes[i];
+    nodes[i]     = nodes[j];
+    nodes[j]     = swap;
+  }
+  for (long i = 0; i < count; i++) {
+    nodes[i]->next = nodes[(i + 1) % count];
+  }
+
+  node_s* node  = nodes[0];
+  double  start = now();
+  for (long i = 0; i < hops; i++) {
+    node = node->next;
+  }
+  double elapsed = now() - start;
+  if (node != nodes[hops % count]) {
+    fprintf(stderr, "cycle corrupted\n");
+    return 1;
+  }
+
+  for (long i = 0; i < count; i++) {
+    free(nodes[i]);
+  }
+  free(nodes);
+
+  bench_report("tlb", 1, hops, elapsed);
+  return 0;
+
+}
@@ -0,0 +1,105 @@
+// ==============================================================================
+/**
+ * bench-xthread.c
+ *
+ * A producer/consumer benchmark, in which every block is freed by a thread
+ * other than the one that allocated it.  Each producer allocates small blocks
+ * and passes them through a bounded queue to its consumer, which frees them.
+ * Prints one line of CSV.  Run it with an allocator preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./bench-xthread [pairs] [blocks per producer]
+ **/
+// ==============================================================================
+
+
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test-util.h"
+
+/** The capacity of each queue; a power of two. */
+#define QUEUE_SIZE     1024
+
+/** The range of block sizes requested. */
+#define MIN_BENCH_SIZE 16
+#define MAX_BENCH_SIZE 512
+
+/**
+ * A single-producer, single-consumer ring of blocks.  The two counters only
+ * ever grow, and each is written by one side only.
+ */
+typedef struct queue {
+  char*         slots[QUEUE_SIZE];
+  unsigned long head __attribute__ ((aligned (64))); // next to take
+  unsigned long tail __attribute__ ((aligned (64))); // next to fill
+} queue_s;
+
+static long blocks_per_producer;
+
+/** Allocate blocks and queue them, waiting while the queue is full. */
+static void* producer (void* arg) {
+
+  queue_s*     queue = arg;
+  unsigned int seed  = (unsigned int)(intptr_t)queue;
+  for (long i = 0; i < blocks_per_producer; i++) {
+    char* block = malloc(MIN_BENCH_SIZE + rand_r(&seed) % (MAX_BENCH_SIZE - MIN_BENCH_SIZE));
+    if (block == NULL) {
+      fprintf(stderr, "malloc failed\n");
+      exit(1);
+    }
+    block[0] = (char)i;
+    while (queue->tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == QUEUE_SIZE) {
+      sched_yield();
+    }
+    queue->slots[queue->tail % QUEUE_SIZE] = block;
+    __atomic_store_n(&queue->tail, queue->tail + 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+
+}
+
+/** Take blocks off the queue and free them, waiting while it is empty. */
+static void* consumer (void* arg) {
+
+  queue_s* queue = arg;
+  for (long i = 0; i < blocks_per_producer; i++) {
+    while (__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == queue->head) {
+      sched_yield();
+    }
+    free(queue->slots[queue->head % QUEUE_SIZE]);
+    __atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+
+}
+
+int main (int argc, char **argv) {
+
+  int pairs           = (argc > 1) ? atoi(argv[1]) : 2;
+  blocks_per_producer = (argc > 2) ? atol(argv[2]) : 1000000;
+
+  queue_s*   queues  = calloc(pairs, sizeof(queue_s));
+  pthread_t* threads = malloc(2 * pairs * sizeof(pthread_t));
+
+  double start = now();
+  for (int p = 0; p < pairs; p++) {
+    pthread_create(&threads[2 * p],     NULL, producer, &queues[p]);
+    pthread_create(&threads[2 * p + 1], NULL, consumer, &queues[p]);
+  }
+  for (int t = 0; t < 2 * pairs; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  double elapsed = now() - start;
+
+  // Count a malloc() and its free() as one operation each.
+  long ops = 2 * blocks_per_producer * pairs;
+  bench_report("xthread", 2 * pairs, ops, elapsed);
+  free(threads);
+  free(queues);
+  return 0;
+
+}
@@ -2,10 +2,60 @@
 /**
  * bf-alloc.c
  *
- * A _best-fit_ heap allocator.  This allocator uses a _doubly-linked free list_
- * from which to allocate the best fitting free block.  If the list does not
- * contain any blocks of sufficient size, it uses _pointer bumping_ to expand
- * the heap.
+ * A _best-fit_ heap allocator.  This allocator uses _segregated free lists_,
+ * one doubly-linked list per size class, from which to allocate the best
+ * fitting free block.  Small sizes each have their own exact class; larger
+ * sizes share classes covering quarters of power-of-two ranges.  Free blocks
+ * of 4 KB and more are instead kept in a _red-black tree_ ordered by size and
+ * address, so the best fit for a large request, taking the lowest address on
+ * a tie, is found in logarithmic time.  Oversized blocks are _split_, and
+ * freed blocks are _coalesced_ with free neighbours found through boundary
+ * tags (a footer at the end of every free block).  If neither the lists nor
+ * the tree contain a block of sufficient size, it uses _pointer bumping_ to
+ * expand the heap.  `BF_FIT_POLICY` trades the quality of the fit for the
+ * cost of the search: first fit, next fit, or good fit in place of best fit.
+ *
+ * An allocated block carries only an 8-byte header: one word packing its
+ * size, its flags, and its owning arena.  The free-list links and the footer
+ * live in the payload of free blocks, where they cost nothing.  A block with
+ * a larger alignment (from posix_memalign() and the like) is cut from a
+ * bigger one, whose unneeded front and tail are freed.
+ *
+ * Requests of up to 256 bytes bypass the blocks altogether and are served from
+ * _slabs_: page-sized runs of equally sized slots with no header at all.  Each
+ * slab's free slots are tracked by a bitmap in a descriptor kept in a table
+ * beside the slab region, so a pointer is recognized as a slot, and its slab
+ * found, by address arithmetic alone.
+ *
+ * The heap is divided into independent _arenas_, each with its own segments,
+ * free lists, and lock.  Threads are assigned to arenas round-robin (or, if
+ * `BF_ARENA_POLICY=cpu`, by the CPU they run on), and each block's header
+ * records its owning arena, so a block freed by any thread is returned to the
+ * arena it came from.  In front of the arenas, each thread keeps a small cache
+ * (_tcache_) of freed blocks per small size class, so most small
+ * malloc()/free() pairs never take a lock.  Blocks in a tcache remain
+ * allocated as far as their arena is concerned.  A thread freeing blocks of
+ * another thread's arena does not take that arena's lock either: it pushes
+ * them onto the arena's lock-free _remote-free list_, which the arena takes
+ * whole and frees the next time one of its own threads takes its lock.
+ *
+ * An arena's heap grows a _segment_ at a time: each is reserved without
+ * being committed, made accessible a couple of megabytes at a time as the
+ * arena bumps through it, and, once full, retired in favour of a new one
+ * twice its size.  A segment table, one byte per 64 MB of address space,
+ * records which arena's segment covers each address, so that free() can
+ * check a block's ownership with a single load.
+ *
+ * With `BF_HUGEPAGES=1`, the arenas' segments and the slab region are aligned
+ * to (at least) 2 MB and marked for transparent huge pages.  Each arena then
+ * takes fresh slabs a huge page at a time, so that its small objects share as
+ * few huge pages as possible, and purging only gives back whole huge pages.
+ *
+ * With `BF_PROFILE` set, a _sampling heap profiler_ records the stack behind
+ * one allocation in about every 512 KB allocated (see `heap-profile.h`).
+ * Each thread counts down the bytes it allocates, so that the cost to the
+ * other allocations is a subtraction; sampled blocks carry a flag in their
+ * header, so that freeing or resizing one tells the profiler.
  **/
 // ==============================================================================
 
@@ -14,43 +64,29 @@
 // ==============================================================================
 // INCLUDES
 
+#define _GNU_SOURCE // for sched_getcpu()
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/mman.h>
 
+#include "alloc-stats.h"
+#include "bf-alloc.h"
+#include "heap-profile.h"
 #include "safeio.h"
 // ==============================================================================
 
 
 
-// ==============================================================================
-// TYPES AND STRUCTURES
-
-/** The header for each allocated object. */
-typedef struct header {
-
-  /** Pointer to the next header in the list. */
-  struct header* next;
-
-  /** Pointer to the previous header in the list. */
-  struct header* prev;
-
-  /** The usable size of the block (exclusive of the header itself). */
-  size_t         size;
-
-  /** Is the block allocated or free? */
-  bool           allocated;
-
-} header_s;
-// ==============================================================================
-
-
-
 // ==============================================================================
 // MACRO CONSTANTS AND FUNCTIONS
 
@@ -65,323 +101,3528 @@ typedef struct header {
 #define MB(size)  (KB(size) * 1024)
 #define GB(size)  (MB(size) * 1024)
 
-/** The virtual address space reserved for the heap. */
-#define HEAP_SIZE GB(2)
+/**
+ * The size of an arena's first segment of the heap; each new segment doubles
+ * the last, up to `MAX_SEGMENT_SIZE`, unless a request needs more.
+ */
+#define MIN_SEGMENT_SIZE MB(64)
+#define MAX_SEGMENT_SIZE GB(1)
+
+/**
+ * Segments are aligned to, and sized in multiples of, a span of 2^26 bytes
+ * (64 MB), so that the segment table can record the owner of every span of
+ * the (47-bit) user address space in a byte.
+ */
+#define SEGMENT_SHIFT 26
+#define SEGMENT_ALIGN ((size_t)1 << SEGMENT_SHIFT)
+#define NUM_SPANS     ((size_t)1 << (47 - SEGMENT_SHIFT))
+
+/** Round `size` up to a multiple of `SEGMENT_ALIGN`. */
+#define SEGMENT_UP(size) (((size) + SEGMENT_ALIGN - 1) & ~(SEGMENT_ALIGN - 1))
+
+/**
+ * A segment is reserved inaccessible, and made accessible (committed) this
+ * many bytes at a time as the arena bumps through it.
+ */
+#define COMMIT_SIZE MB(2)
+
+/** The most arenas that can be configured (via `BF_ARENAS`). */
+#define MAX_ARENAS 64
+
+/**
+ * Requests of at least this many bytes get a mapping of their own, unless
+ * `BF_MMAP_THRESHOLD` says otherwise.
+ */
+#define DEFAULT_MMAP_THRESHOLD KB(128)
+
+/**
+ * How long free memory stays resident before it is purged, unless
+ * `BF_DECAY_MS` says otherwise.
+ */
+#define DEFAULT_DECAY_MS 1000
+
+/**
+ * The fit policies, chosen by `BF_FIT_POLICY`.  Each picks among the free
+ * blocks that fit a request, searched in list order (or, in the tree, along
+ * the path down from the root):
+ *   best  -- the smallest (the default);
+ *   first -- the first found;
+ *   next  -- the first found from where the last search left off;
+ *   good  -- the smallest of the first `good_fit_k` found.
+ */
+#define FIT_BEST  0
+#define FIT_FIRST 1
+#define FIT_NEXT  2
+#define FIT_GOOD  3
+
+/** The number of fit policies, and so of entries in `fit_policy_names`. */
+#define NUM_FIT_POLICIES 4
+
+/** The candidates good fit considers, unless `BF_FIT_POLICY=good:<k>` says otherwise. */
+#define DEFAULT_GOOD_FIT_K 4
+
+/**
+ * The space a header takes in front of an allocated block: just its tag.  The
+ * rest of `header_s` overlays the payload and is only used while free.
+ */
+#define HEADER_SIZE sizeof(size_t)
 
 /** Given a pointer to a header, obtain a `void*` pointer to the block itself. */
-#define HEADER_TO_BLOCK(hp) ((void*)((intptr_t)hp + sizeof(header_s)))
+#define HEADER_TO_BLOCK(hp) ((void*)((intptr_t)(hp) + HEADER_SIZE))
 
 /** Given a pointer to a block, obtain a `header_s*` pointer to its header. */
-#define BLOCK_TO_HEADER(bp) ((header_s*)((intptr_t)bp - sizeof(header_s)))
-// ==============================================================================
+#define BLOCK_TO_HEADER(bp) ((header_s*)((intptr_t)(bp) - HEADER_SIZE))
+
+/**
+ * Flags kept in the low bits of a header's tag, which are otherwise always 0
+ * since block sizes are multiples of `ALIGNMENT`.
+ */
+#define ALLOCATED_FLAG ((size_t)1) // the block is allocated (or tcached)
+#define PREV_FREE_FLAG ((size_t)2) // the block before this one is free
+#define CACHED_FLAG    ((size_t)4) // the (allocated) block is in a tcache or remote-free list
+#define PURGED_FLAG    ((size_t)8) // the (free) block's pages have been purged
+#define FLAG_MASK      ((size_t)0xf)
 
+/** The owning arena's index is kept in the top bits of a header's tag. */
+#define ARENA_SHIFT 48
 
-// ==============================================================================
-// GLOBALS
+/**
+ * A flag kept just below the arena index, marking a block sampled by the heap
+ * profiler, which must be told when it is freed.  Block sizes never reach it.
+ */
+#define SAMPLED_FLAG ((size_t)1 << (ARENA_SHIFT - 1))
+
+/**
+ * The arena index recorded for a block with a mapping of its own.  The block
+ * starts `ALIGNMENT` bytes into the mapping (or, if it was asked for a larger
+ * alignment, as far in as that needs), with its header in front of it in the
+ * mapping's first page, and its size is that of the whole mapping.
+ */
+#define MMAP_ARENA 0xffff
 
-/** The address of the next available byte in the heap region. */
-static intptr_t free_addr  = 0;
+/** Given the header of a block with a mapping of its own, obtain the mapping's start. */
+#define MMAP_START(hp) PAGE_DOWN((intptr_t)(hp))
 
-/** The beginning of the heap. */
-static intptr_t start_addr = 0;
+/** Build a tag from a block size, an arena index, and flags. */
+#define MAKE_TAG(size, arena, flags) ((size) | ((size_t)(arena) << ARENA_SHIFT) | (flags))
 
-/** The end of the heap. */
-static intptr_t end_addr   = 0;
+/** The size of a block, including its header, from its header. */
+#define BLOCK_SIZE(hp)   ((hp)->tag & ~FLAG_MASK & (SAMPLED_FLAG - 1))
 
-/** The head of the free list. */
-static header_s* free_list_head = NULL;
+/** The index of the arena that owns a block, from its header. */
+#define BLOCK_ARENA(hp)  ((hp)->tag >> ARENA_SHIFT)
 
-/** The head of the allocated list. */ 
-static header_s* allocated_list_head = NULL;
+/** Test one of a block's flags. */
+#define HAS_FLAG(hp, flag) (((hp)->tag & (flag)) != 0)
 
-// ==============================================================================
+/**
+ * Set or clear one of a block's flags.  A thread flips the `CACHED_FLAG` (or
+ * `SAMPLED_FLAG`) of its own blocks without any lock, while the holder of the
+ * arena's lock may at the same moment flip the `PREV_FREE_FLAG` of the same
+ * tag, having freed or carved the block before it, so both sides update the
+ * word atomically lest one update be lost.
+ */
+#define SET_FLAG(hp, flag)   __atomic_fetch_or(&(hp)->tag, (flag), __ATOMIC_RELAXED)
+#define CLEAR_FLAG(hp, flag) __atomic_fetch_and(&(hp)->tag, ~(flag), __ATOMIC_RELAXED)
 
+/** The number of payload bytes a block can hold. */
+#define USABLE_SIZE(hp)  (BLOCK_SIZE(hp) - HEADER_SIZE)
 
+/** Round `addr` up (or down) to a multiple of the page size. */
+#define PAGE_UP(addr)   (((addr) + (PAGE_SIZE - 1)) & ~(PAGE_SIZE - 1))
+#define PAGE_DOWN(addr) ((addr) & ~(PAGE_SIZE - 1))
+
+/** Given a pointer to a header, obtain a pointer to the header that follows it. */
+#define NEXT_HEADER(hp) ((header_s*)((intptr_t)(hp) + BLOCK_SIZE(hp)))
 
-// ==============================================================================
 /**
- * The initialization method.  If this is the first use of the heap, initialize it.
+ * The footer of a free block: its size, in the block's last word, so that the
+ * block after it can find (and coalesce with) it in O(1).
  */
+#define FOOTER(hp) (*(size_t*)((intptr_t)NEXT_HEADER(hp) - sizeof(size_t)))
 
-void init () {
+/**
+ * Given a pointer to a header whose `PREV_FREE_FLAG` is set, obtain a pointer
+ * to the header of the free block before it.
+ */
+#define PREV_HEADER(hp) ((header_s*)((intptr_t)(hp) - *(size_t*)((intptr_t)(hp) - sizeof(size_t))))
 
-  // Only do anything if there is no heap region (i.e., first time called).
-  if (start_addr == 0) {
+/**
+ * The smallest block: one that can hold, while free, its tag, both list links,
+ * and its footer.  Remainders smaller than this are left in the allocated
+ * block as slack rather than split off.
+ */
+#define MIN_BLOCK_SIZE 32
 
-    DEBUG("Trying to initialize");
-    
-    // Allocate virtual address space in which the heap will reside. Make it
-    // un-shared and not backed by any file (_anonymous_ space).  A failure to
-    // map this space is fatal.
-    void* heap = mmap(NULL,
-		      HEAP_SIZE,
-		      PROT_READ | PROT_WRITE,
-		      MAP_PRIVATE | MAP_ANONYMOUS,
-		      -1,
-		      0);
-    if (heap == MAP_FAILED) {
-      ERROR("Could not mmap() heap region");
-    }
-
-    // Hold onto the boundaries of the heap as a whole.
-    start_addr = (intptr_t)heap;
-    end_addr   = start_addr + HEAP_SIZE;
-    free_addr  = start_addr;
+/** The alignment of every block; requested sizes are rounded up to it. */
+#define ALIGNMENT 16
 
-    // DEBUG: Emit a message to indicate that this allocator is being called.
-    DEBUG("bf-alloc initialized");
+/** Round `size` up to a multiple of `ALIGNMENT`. */
+#define ALIGN_UP(size) (((size) + (ALIGNMENT - 1)) & ~((size_t)ALIGNMENT - 1))
 
-  }
+/**
+ * The size of the block that serves a request of `size` bytes.  Blocks start
+ * 8 bytes past an `ALIGNMENT` boundary, so that their payloads are aligned.
+ */
+#define REQUEST_TO_BLOCK_SIZE(size) \
+  ((size) + HEADER_SIZE <= MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : ALIGN_UP((size) + HEADER_SIZE))
 
-} // init ()
+/** Block sizes up to this many bytes each get an exact size class. */
+#define MAX_SMALL_SIZE 512
+
+/** The number of exact size classes (one per `ALIGNMENT` step). */
+#define NUM_SMALL_CLASSES (MAX_SMALL_SIZE / ALIGNMENT)
+
+/** The log2 of `MAX_SMALL_SIZE`; the power-of-two classes start above it. */
+#define SMALL_SIZE_SHIFT 9
+
+/** Each power-of-two range above `MAX_SMALL_SIZE` is split into 2^this classes. */
+#define RANGE_SPLIT_BITS 2
+
+/**
+ * Free blocks of at least this many bytes are kept in a size-ordered tree
+ * rather than on the size classes' lists.
+ */
+#define TREE_MIN_SIZE KB(4)
+
+/**
+ * The total number of size classes: the exact classes, then the classes for
+ * the power-of-two ranges above `MAX_SMALL_SIZE`.  This is more than enough
+ * for every size below `TREE_MIN_SIZE`.
+ */
+#define NUM_SIZE_CLASSES 64
+
+/** The size classes counted in the statistics: the lists', then the tree's. */
+#define NUM_STATS_CLASSES (NUM_SIZE_CLASSES + 1)
+
+/** The statistics class of a block of the given size. */
+#define STATS_CLASS(size) (((size) >= TREE_MIN_SIZE) ? NUM_SIZE_CLASSES : size_class(size))
+
+/** The number of words in the bitmap of non-empty size classes. */
+#define CLASS_MAP_WORDS (NUM_SIZE_CLASSES / 64)
+
+/** The most blocks a thread caches per size class before returning some. */
+#define TCACHE_MAX_COUNT 32
+
+/** The number of blocks fetched into an empty tcache bin with one locking. */
+#define TCACHE_REFILL_COUNT 8
+
+/** Requests up to this many bytes are served from slabs rather than blocks. */
+#define MAX_SLAB_SIZE 256
+
+/** The number of slab size classes (one per `ALIGNMENT` step). */
+#define NUM_SLAB_CLASSES (MAX_SLAB_SIZE / ALIGNMENT)
+
+/** The size of each slab: a run of equally sized slots. */
+#define SLAB_SIZE KB(4)
+
+/** The number of words in a slab's bitmap of free slots. */
+#define SLAB_MAP_WORDS (SLAB_SIZE / ALIGNMENT / 64)
+
+/** The virtual address space reserved for all slabs, shared by the arenas. */
+#define SLAB_REGION_SIZE GB(1)
+
+/** The size of a transparent huge page, and the slabs that fill one. */
+#define HUGE_PAGE_SIZE       MB(2)
+#define SLABS_PER_HUGE_PAGE  (HUGE_PAGE_SIZE / SLAB_SIZE)
+
+/**
+ * Round `addr` up (or down) to a multiple of `purge_unit`, the smallest span
+ * that purging gives back.
+ */
+#define PURGE_UP(addr)   (((addr) + (purge_unit - 1)) & ~(purge_unit - 1))
+#define PURGE_DOWN(addr) ((addr) & ~(purge_unit - 1))
+
+/** Is `ptr` inside the slab region?  A single comparison, so O(1). */
+#define IS_SLAB_PTR(ptr) ((uintptr_t)(ptr) - slab_start < SLAB_REGION_SIZE)
+
+/** Given a pointer into the slab region, obtain its slab's descriptor. */
+#define SLAB_OF(ptr) (&slab_table[((uintptr_t)(ptr) - slab_start) / SLAB_SIZE])
+
+/**
+ * Given a slab's descriptor and a byte offset into the slab, obtain the index
+ * of the slot there.  Multiplying by the slab's reciprocal avoids a division;
+ * it is exact since offsets and slot sizes are small.
+ */
+#define SLOT_INDEX(slab, offset) ((uint32_t)(((uint64_t)(offset) * (slab)->slot_reciprocal) >> 32))
+
+/**
+ * The second word of a slab slot, which holds `slot_key` while the slot is
+ * cached (the first links it into its tcache bin or remote-free list).
+ */
+#define SLOT_KEY(ptr) (((uintptr_t*)(ptr))[1])
+
+/** Given a slab's descriptor, obtain the address of its first slot. */
+#define SLAB_BASE(slab) (slab_start + (uintptr_t)((slab) - slab_table) * SLAB_SIZE)
 // ==============================================================================
 
 
+
 // ==============================================================================
+// TYPES AND STRUCTURES
+
 /**
- * Allocate and return `size` bytes of heap space.  Specifically, search the
- * free list, choosing the _best fit_.  If no such block is available, expand
- * into the heap region via _pointer bumping_.
- *
- * \param size The number of bytes to allocate.
- * \return A pointer to the allocated block, if successful; `NULL` if unsuccessful.
+ * The header of each block.  Only `tag` is kept for an allocated block; its
+ * payload begins where `next` would be.  The links are only meaningful while
+ * the block is free (or sitting in a tcache, which uses `next` alone).
  */
-void* malloc (size_t size) {
+typedef struct header {
 
-  init(); // make sure heap is initialized
+  /** The block's size (header included), flags, and owning arena, packed. */
+  size_t         tag;
 
-  if (size == 0) { // if size is 0 do nothing and return NULL
-    return NULL;
-  }
+  /** Pointer to the next header in the free list or tcache bin. */
+  struct header* next;
 
-  // DEBUG("List head address before malloc call ", (intptr_t)allocated_list_head);
-  
-  header_s* current = free_list_head; // create a header and set it equal to the current head of the free list
-  header_s* best    = NULL;
-  while (current != NULL) { // while there are free spaces to consider
+  /** Pointer to the previous header in the free list. */
+  struct header* prev;
 
-    if (current->allocated) {
-      ERROR("Allocated block on free list", (intptr_t)current); 
-    }
-    
-    if ( (best == NULL && size <= current->size) ||
-	 (best != NULL && size <= current->size && current->size < best->size) ) {
-	    // if best is null and block can fit in current space in free list
-	    // OR if best is not null but the size can fit and current AND this size is 
-	    // smaller than the previous best size
-      best = current; // then set the best space to be the current space
-    }
+} header_s;
 
-    if (best != NULL && best->size == size) { 
-      break;
-    }
+/**
+ * A free block of at least `TREE_MIN_SIZE` bytes, as a node of its arena's
+ * red-black tree of large free blocks.  The tree is ordered by size, then by
+ * address.  Like the list links, the node overlays the block's payload.
+ */
+typedef struct tree_node {
 
-    current = current->next; // set current to be it's next element
-    
-  }
+  /** The block's tag, as in `header_s`. */
+  size_t            tag;
 
-  void* new_block_ptr = NULL;
-  if (best != NULL) { // allocate from best fit block if available otherwise use pointer bumping
+  /** The left (smaller) and right (larger) children. */
+  struct tree_node* child[2];
 
-    if (best->prev == NULL) {
-      free_list_head   = best->next; // if best has no prev, set free list head to its next
-    } else {
-      best->prev->next = best->next; // set best's prev's next to be best's next
-    }
-    if (best->next != NULL) {
-      best->next->prev = best->prev; // if best's next != NULL, set its prev to be best's prev
-    }
-    best->prev = NULL; // set best's prev to be NULL
+  /** The parent, or the arena's sentinel at the root. */
+  struct tree_node* parent;
 
-    // my code
-    best->next = allocated_list_head;
-    if(allocated_list_head != NULL) {
-    	allocated_list_head->prev = best; // update allocated list head to be best
-    }
-    allocated_list_head = best;
-    // end of my code
+  /** Is the node red (or black)? */
+  bool              red;
 
-    best->allocated = true; // set the blocks allocated field to be true
-    new_block_ptr   = HEADER_TO_BLOCK(best); // update block pointer
-    
-  } else { // no suitable block found in free list, use pointer bumping
+} tree_node_s;
 
-    int modVal = free_addr % 16; // calc the mod of free_addr
-    if (modVal != 0) { // if current alignment is < 8, adjust it to next 8 byte
-	  free_addr += (16-modVal);
-    }
+/**
+ * The descriptor of a slab, kept in a table beside the slab region rather than
+ * in the slab itself, so that slots carry no header and fill the whole slab.
+ * A descriptor is only changed under the lock of the arena that owns it, and
+ * each fills one cache line.
+ */
+typedef struct slab {
 
-    header_s* header_ptr = (header_s*)free_addr; // create a new block at the current free
-    new_block_ptr = HEADER_TO_BLOCK(header_ptr);
+  /** The next slab in the arena's partial (or empty) slab list. */
+  struct slab* next;
 
-    header_ptr->next = allocated_list_head; // update header ptr's next to be allocated list head
-    if (header_ptr->next != NULL) {
-	    allocated_list_head->prev = header_ptr; // set allocated list head prev to be header ptr
-    }
-    allocated_list_head = header_ptr; // set allocated list head to be header ptr
+  /** The previous slab in the arena's partial slab list. */
+  struct slab* prev;
 
-    // update block metadata
-    header_ptr->prev      = NULL;
-    header_ptr->size      = size;
-    header_ptr->allocated = true;
-    
-    // update free addy for the next allocation
-    intptr_t new_free_addr = (intptr_t)new_block_ptr + size;
-    if (new_free_addr > end_addr) {
-      return NULL; // heap boundary reached
-    } else {
-      free_addr = new_free_addr; // else set free addy to be new free addy
-    }
-  }
+  /** A bit per slot, set while the slot is free. */
+  uint64_t     free_map[SLAB_MAP_WORDS];
 
-  /*
-  // printing my debug info 
-  header_s* tmp = allocated_list_head;
-  DEBUG("List head address after malloc call ", (intptr_t) allocated_list_head);
-  while (tmp != NULL && printDebug) { // this while loop prints all the blocks in allocated list
-	DEBUG("Allocated block address: ", (intptr_t) HEADER_TO_BLOCK(tmp));
-	tmp = tmp->next;
-  }  
-  */
- 
+  /** The size of each slot (0 if the slab has never been used). */
+  uint16_t     slot_size;
 
-  return new_block_ptr; // return addy of the new block
+  /** The number of slots in the slab. */
+  uint16_t     num_slots;
 
-} // malloc()
+  /** The number of slots currently free. */
+  uint16_t     free_slots;
+
+  /** The index of the arena that owns the slab. */
+  uint16_t     arena;
+
+  /** 2^32 / `slot_size`, rounded up, for `SLOT_INDEX`. */
+  uint32_t     slot_reciprocal;
+
+  /** Has the (empty) slab's memory been returned to the OS? */
+  bool         purged;
+
+} __attribute__ ((aligned (64))) slab_s;
+
+/**
+ * A thread's cache of freed small blocks and slots, one singly-linked bin per
+ * class.  The first `NUM_SLAB_CLASSES` bins hold slab slots; the rest hold
+ * blocks of the exact size classes above `MAX_SLAB_SIZE`.  Each entry is
+ * linked through its first word.
+ */
+typedef struct tcache {
+
+  /** The cached blocks or slots of each exact size class. */
+  void*        bins[NUM_SMALL_CLASSES];
+
+  /** The number of blocks in each bin. */
+  unsigned int counts[NUM_SMALL_CLASSES];
+
+  /** Has the thread-exit flush been registered for this thread? */
+  bool         registered;
+
+  /** Has the cache been flushed at thread exit (and so is out of use)? */
+  bool         disabled;
+
+} tcache_s;
+
+/**
+ * An independent heap: its own segments, free lists, and lock.  Arenas are
+ * aligned to cache lines so that their locks do not share one.
+ */
+typedef struct arena {
+
+  /** The lock protecting everything else in the arena. */
+  pthread_mutex_t lock;
+
+  /** The address of the next available byte in the current segment. */
+  intptr_t        free_addr;
+
+  /** The beginning of the current segment (0 until the first is needed). */
+  intptr_t        start_addr;
+
+  /**
+   * The end of the current segment's space for blocks.  Its last 8 bytes are
+   * kept for the fence that is put there when it is retired.
+   */
+  intptr_t        end_addr;
+
+  /** The end of the part of the current segment that is committed. */
+  intptr_t        commit_end;
+
+  /** The size of the next segment. */
+  size_t          segment_size;
+
+  /**
+   * The bytes in the arena's retired segments, all of which count toward the
+   * high water mark, since what was left of each went to the free blocks.
+   */
+  size_t          retired_bytes;
+
+  /** The heads of the free lists, one per size class. */
+  header_s*       free_lists[NUM_SIZE_CLASSES];
+
+  /** A bit per size class, set when that class's free list is non-empty. */
+  uint64_t        nonempty_classes[CLASS_MAP_WORDS];
+
+  /** The root of the tree of large free blocks. */
+  tree_node_s*    tree_root;
+
+  /** The tree's sentinel, standing in for every leaf (and the root's parent). */
+  tree_node_s     tree_nil;
+
+  /**
+   * Where next fit resumes its search of each free list, and of the tree:
+   * the block after the last one it took, or `NULL` to start at the head
+   * (or the smallest).
+   */
+  header_s*       rovers[NUM_SIZE_CLASSES];
+  tree_node_s*    tree_rover;
+
+  /** The slabs of each slab class that have at least one free slot. */
+  slab_s*         partial_slabs[NUM_SLAB_CLASSES];
+
+  /** Slabs with no slots in use, ready to take on any class. */
+  slab_s*         empty_slabs;
+
+  /**
+   * The highest `free_addr` since the bump region was last purged.  Nothing
+   * at or above it has been touched since, so it is still zero.
+   */
+  intptr_t        dirty_end;
+
+  /** When the arena's free memory was last purged, in milliseconds. */
+  long            last_purge_ms;
+
+  /**
+   * With huge pages, the next and end indices of the run of fresh slabs that
+   * the arena has taken from the slab region, a huge page's worth at a time.
+   */
+  size_t          slab_run_next;
+  size_t          slab_run_end;
+
+  /** The arena's position in `arenas`, as recorded in block headers. */
+  uint16_t        index;
+
+  /**
+   * The counters of blocks (or slots) in use and free in each statistics
+   * class.  Blocks in a tcache or on a remote-free list count as in use.
+   */
+  alloc_class_stats_s class_stats[NUM_STATS_CLASSES];
+
+  /** The bytes in use, and their peak. */
+  size_t          bytes_in_use;
+  size_t          peak_in_use;
+
+  /** The highest `free_addr` ever in the current segment. */
+  intptr_t        high_water;
+
+  /** The allocations that searched the free blocks, and the blocks examined. */
+  size_t          searches;
+  size_t          probes;
+
+  /**
+   * Slots and blocks freed by threads of other arenas, linked through their
+   * first words, waiting to be freed into this arena.  Other threads push
+   * onto it without the lock; the arena takes it whole under the lock.  It
+   * has a cache line of its own, so that pushing does not disturb the lock.
+   */
+  void*           remote_frees __attribute__ ((aligned (64)));
+
+} __attribute__ ((aligned (64))) arena_s;
 // ==============================================================================
 
 
 
 // ==============================================================================
+// GLOBALS
+
+/** The arenas; only the first `num_arenas` are used. */
+static arena_s arenas[MAX_ARENAS];
+
+/** The number of arenas in use, set once at initialization. */
+static unsigned int num_arenas = 0;
+
+/** Should threads use the arena of their current CPU (else round-robin)? */
+static bool arena_by_cpu = false;
+
+/** The round-robin counter for assigning threads to arenas. */
+static unsigned int next_arena = 0;
+
+/** Requests of at least this many bytes are mapped individually. */
+static size_t mmap_threshold = DEFAULT_MMAP_THRESHOLD;
+
+/** How long free memory stays resident before being purged (< 0: forever). */
+static long decay_ms = DEFAULT_DECAY_MS;
+
+/** The fit policy, one of the `FIT_` values. */
+static int fit_policy = FIT_BEST;
+
+/** The number of fitting candidates good fit chooses among. */
+static unsigned int good_fit_k = DEFAULT_GOOD_FIT_K;
+
+/** The names of the fit policies, as `BF_FIT_POLICY` gives them. */
+static const char* fit_policy_names[NUM_FIT_POLICIES] = { "best", "first", "next", "good" };
+
+/** Has the allocator been initialized? */
+static bool initialized = false;
+
+/** The lock that serializes initialization. */
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
- * Deallocate a given block on the heap.  Add the given block (if any) to the
- * free list.
- *
- * \param ptr A pointer to the block to be deallocated.
+ * The beginning of the slab region.  Until it is reserved (or if it cannot
+ * be), this lies at the very top of the address space, where no user pointer
+ * can be, so that `IS_SLAB_PTR` is always false.
  */
-void free (void* ptr) {
+static uintptr_t slab_start = (uintptr_t)0 - SLAB_REGION_SIZE;
 
-  if (ptr == NULL) {
-    return; // nothing to free so return NULL
-  }
+/** The descriptors of the slabs, one per `SLAB_SIZE` of the slab region. */
+static slab_s* slab_table = NULL;
 
-  //DEBUG("List head address BEFORE FREE call ", (intptr_t) allocated_list_head);
+/** The number of slabs handed out to the arenas so far. */
+static size_t slabs_used = 0;
 
-  header_s* header_ptr = BLOCK_TO_HEADER(ptr); // retrieve header of block to be freed
+/**
+ * The segment table: for each `SEGMENT_ALIGN` span of the address space, 1
+ * plus the index of the arena whose segment covers it, or 0 if none does.
+ * Segments are never unmapped, so an entry, once set, never changes.
+ */
+static uint8_t segment_table[NUM_SPANS];
 
-  if (!header_ptr->allocated) {
-    ERROR("Double-free: ", (intptr_t)header_ptr); // if header's field allocated is free then return an error stating they tried to double free a block
-  }
+/** Are the regions laid out for transparent huge pages? */
+static bool huge_pages = false;
 
-  if (header_ptr->prev == NULL) { // check if block to be freed is at beginning of allocated list
-      allocated_list_head = header_ptr->next; // set allocate list head to be its next
-  } 
-  else {
-      header_ptr->prev->next = header_ptr->next; // block to be freed is not at the beginning so update the previous block's next ptr
-  }
-  if (header_ptr->next != NULL) { // update the prev ptr of the next block in the allocated list
-      header_ptr->next->prev = header_ptr->prev;
-  }
-  header_ptr->prev = NULL; // clear the prev ptr of the block being freed
+/** The smallest span that purging gives back: a page, or a huge page. */
+static intptr_t purge_unit = 0;
 
-  header_ptr->next = free_list_head; // set the next ptr of the free block to return the current head of the free list
-  free_list_head   = header_ptr; // update the head of the free list to point to the freed block
-  header_ptr->prev = NULL; // clear prev pointer of freed block
-  if (header_ptr->next != NULL) { // if free list is not empty update prev ptr
-    header_ptr->next->prev = header_ptr;
-  }
-  header_ptr->allocated = false; // set field of block to be un-allocated
+/** The bytes in individually mapped blocks, and their peak. */
+static size_t mmapped_bytes      = 0;
+static size_t peak_mmapped_bytes = 0;
 
-  /*
-  // my debug info
-  header_s* tmp = allocated_list_head;
-  DEBUG("List head address AFTER FREE call ", (intptr_t) allocated_list_head);
-  while (tmp != NULL && printDebug) { // print the allocated list 
-	DEBUG("Allocated block addresses: ", (intptr_t) HEADER_TO_BLOCK(tmp));
-	tmp = tmp->next;
-  }
-  */
+/** Should the statistics be printed at exit? */
+static bool stats_at_exit = false;
 
-}
-// free()
-// ==============================================================================
+/** The key whose destructor flushes a thread's tcache when the thread exits. */
+static pthread_key_t tcache_key;
 
+/**
+ * The mark of a cached slab slot: one in a tcache or on a remote-free list is
+ * free but still marked allocated in its slab's map, so this, in its second
+ * word, is what catches it being freed again.  Drawn at random once, so that
+ * live data is (almost) never mistaken for it.
+ */
+static uintptr_t slot_key = 0;
 
+/**
+ * This thread's cache of small blocks, and its round-robin arena.
+ * Initial-exec TLS is used so that reaching them never calls back into
+ * malloc() when preloaded.
+ */
+static __thread tcache_s tcache        __attribute__ ((tls_model ("initial-exec")));
+static __thread arena_s* thread_arena  __attribute__ ((tls_model ("initial-exec")));
 
+/** Is the heap profiler sampling allocations? */
+static bool profiling = false;
 
-// ==============================================================================
 /**
- * Allocate a block of `nmemb * size` bytes on the heap, zeroing its contents.
- *
- * \param nmemb The number of elements in the new block.
- * \param size  The size, in bytes, of each of the `nmemb` elements.
- * \return      A pointer to the newly allocated and zeroed block, if successful;
- *              `NULL` if unsuccessful.
+ * The bytes this thread has left to allocate before its next sample, and
+ * the random state that draws the intervals, which is 0 until seeded.
  */
-void* calloc (size_t nmemb, size_t size) {
+static __thread long     sample_countdown __attribute__ ((tls_model ("initial-exec")));
+static __thread uint64_t sample_seed      __attribute__ ((tls_model ("initial-exec")));
 
-  // Allocate a block of the requested size.
-  size_t block_size    = nmemb * size;
-  void*  new_block_ptr = malloc(block_size);
+// ==============================================================================
 
-  // If the allocation succeeded, clear the entire block.
-  if (new_block_ptr != NULL) {
-    memset(new_block_ptr, 0, block_size);
+
+
+// ==============================================================================
+/**
+ * Handlers that keep the arena locks consistent across fork(): take them all
+ * (in order) before forking, so that no other thread holds one mid-update,
+ * and release them in both the parent and the (single-threaded) child.
+ */
+static void lock_arenas_for_fork () {
+  for (unsigned int i = 0; i < num_arenas; i++) {
+    pthread_mutex_lock(&arenas[i].lock);
   }
+  heap_profile_lock();
+}
 
-  return new_block_ptr;
-  
-} // calloc ()
+static void unlock_arenas_after_fork () {
+  heap_profile_unlock();
+  for (unsigned int i = 0; i < num_arenas; i++) {
+    pthread_mutex_unlock(&arenas[i].lock);
+  }
+}
 // ==============================================================================
 
 
 
+static void tcache_flush_at_exit (void* unused);
+static void heap_free (arena_s* arena, header_s* header_ptr);
+static void stats_signal_handler (int signal_number);
+static void profile_signal_handler (int signal_number);
+
 // ==============================================================================
 /**
- * Update the given block at `ptr` to take on the given `size`.  Here, if `size`
- * fits within the given block, then the block is returned unchanged.  If the
- * `size` is an increase for the block, then a new and larger block is
- * allocated, and the data from the old block is copied, the old block freed,
- * and the new block returned.
+ * Reserve a region of address space, without committing swap, since most of
+ * it is never touched.  A larger alignment than a page is had by
+ * over-reserving and trimming the ends.  With huge pages, the region is
+ * marked for transparent huge pages.
  *
- * \param ptr  The block to be assigned a new size.
- * \param size The new size that the block should assume.
- * \return     A pointer to the resultant block, which may be `ptr` itself, or
- *             may be a newly allocated block.
+ * \param size      The size of the region, a multiple of `alignment`.
+ * \param alignment The region's alignment, a power of two of at least a page.
+ * \param prot      The region's protection; `PROT_NONE` reserves it without
+ *                  committing it at all.
+ * \return          The region, or `MAP_FAILED` if it could not be reserved.
  */
-void* realloc (void* ptr, size_t size) {
+static void* map_region (size_t size, size_t alignment, int prot) {
 
-  // Special case: If there is no original block, then just allocate the new one
-  // of the given size.
-  if (ptr == NULL) {
-    return malloc(size);
+  size_t slack  = (alignment > (size_t)PAGE_SIZE) ? alignment : 0;
+  void*  region = mmap(NULL, size + slack, prot,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED) {
+    return region;
   }
 
-  // Special case: If the new size is 0, that's tantamount to freeing the block.
-  if (size == 0) {
-    free(ptr);
-    return NULL;
+  uintptr_t start = ((uintptr_t)region + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  if (slack != 0) {
+    if (start > (uintptr_t)region) {
+      munmap(region, start - (uintptr_t)region);
+    }
+    if (start + size < (uintptr_t)region + size + slack) {
+      munmap((void*)(start + size), (uintptr_t)region + slack - start);
+    }
   }
+  if (huge_pages) {
+    madvise((void*)start, size, MADV_HUGEPAGE);
+  }
+  return (void*)start;
 
-  // Get the current block size from its header.
-  header_s* header_ptr = BLOCK_TO_HEADER(ptr);
+} // map_region ()
+// ==============================================================================
 
-  // If the new size isn't an increase, then just return the original block as-is.
-  if (size <= header_ptr->size) {
-    return ptr;
-  }
 
-  // The new size is an increase.  Allocate the new, larger block, copy the
-  // contents of the old into it, and free the old.
-  void* new_block_ptr = malloc(size);
-  if (new_block_ptr != NULL) {
-    memcpy(new_block_ptr, ptr, header_ptr->size);
-    free(ptr);
+
+// ==============================================================================
+/**
+ * Reserve the slab region and its table of descriptors.  Neither is committed
+ * until touched.  If either cannot be reserved, small requests are served by
+ * blocks instead.
+ */
+static void slab_region_init () {
+
+  size_t table_size = SLAB_REGION_SIZE / SLAB_SIZE * sizeof(slab_s);
+  void*  region     = map_region(SLAB_REGION_SIZE, huge_pages ? HUGE_PAGE_SIZE : (size_t)PAGE_SIZE,
+                                 PROT_READ | PROT_WRITE);
+  void*  table      = mmap(NULL, table_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED || table == MAP_FAILED) {
+    if (region != MAP_FAILED) {
+      munmap(region, SLAB_REGION_SIZE);
+    }
+    if (table != MAP_FAILED) {
+      munmap(table, table_size);
+    }
+    return;
   }
-    
-  return new_block_ptr;
-  
-} // realloc()
+
+  slab_table = table;
+  slab_start = (uintptr_t)region;
+
+} // slab_region_init ()
 // ==============================================================================
 
 
+
+// ==============================================================================
+/**
+ * The initialization method.  If this is the first use of the allocator, set
+ * up the arenas, whose segments are only mapped once a thread needs them.
+ * The environment can change the defaults:
+ *   `BF_ARENAS`         -- the number of arenas (default: the number of CPUs);
+ *   `BF_ARENA_POLICY`   -- `cpu` to choose arenas by CPU, not round-robin;
+ *   `BF_MMAP_THRESHOLD` -- the request size at which blocks are mapped;
+ *   `BF_DECAY_MS`       -- how long free memory stays before it is purged;
+ *   `BF_FIT_POLICY`     -- the fit policy (an unknown one is reported);
+ *   `BF_HUGEPAGES`      -- lay the heap out for transparent huge pages;
+ *   `BF_STATS`          -- print the statistics at exit;
+ *   `BF_STATS_SIGNAL`   -- a signal that prints them at any time;
+ *   `BF_PROFILE`        -- start the heap profiler, writing a profile to files
+ *                          of this name at exit;
+ *   `BF_PROFILE_RATE`   -- the profiler's mean bytes between samples;
+ *   `BF_PROFILE_SIGNAL` -- a signal that writes a profile at any time.
+ */
+
+void init () {
+
+  // Only do anything the first time called.  The unlocked check keeps the
+  // common case cheap; the locked one makes sure only one thread does it.
+  if (__atomic_load_n(&initialized, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+
+  pthread_mutex_lock(&init_lock);
+  bool first_time = !initialized;
+  if (first_time) {
+
+    DEBUG("Trying to initialize");
+
+    long        count = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* env   = getenv("BF_ARENAS");
+    if (env != NULL && atoi(env) > 0) {
+      count = atoi(env);
+    }
+    num_arenas   = (count < 1) ? 1 : (count > MAX_ARENAS) ? MAX_ARENAS : (unsigned int)count;
+    env          = getenv("BF_ARENA_POLICY");
+    arena_by_cpu = (env != NULL && strcmp(env, "cpu") == 0);
+    env          = getenv("BF_MMAP_THRESHOLD");
+    if (env != NULL && atol(env) > 0) {
+      mmap_threshold = ((size_t)atol(env) < MAX_SEGMENT_SIZE) ? (size_t)atol(env) : MAX_SEGMENT_SIZE;
+    }
+    env          = getenv("BF_DECAY_MS");
+    if (env != NULL) {
+      decay_ms = atol(env);
+    }
+    env          = getenv("BF_HUGEPAGES");
+    huge_pages   = (env != NULL && atoi(env) != 0);
+    purge_unit   = huge_pages ? (intptr_t)HUGE_PAGE_SIZE : (intptr_t)PAGE_SIZE;
+    env          = getenv("BF_FIT_POLICY");
+    if (env != NULL) {
+      // A run measuring the wrong policy would go unnoticed, so say so.
+      int    chosen = -1;
+      size_t length = 0;
+      for (int policy = 0; policy < NUM_FIT_POLICIES && chosen < 0; policy++) {
+        length = strlen(fit_policy_names[policy]);
+        if (strncmp(env, fit_policy_names[policy], length) == 0 &&
+            (env[length] == '\0' || env[length] == ':')) {
+          chosen = policy;
+        }
+      }
+      if (chosen < 0) {
+        PRINT("bf-alloc: unknown BF_FIT_POLICY; using best fit");
+      } else {
+        fit_policy = chosen;
+        if (env[length] == ':') {
+          if (fit_policy == FIT_GOOD && atoi(env + length + 1) > 0) {
+            good_fit_k = atoi(env + length + 1);
+          } else {
+            PRINT("bf-alloc: BF_FIT_POLICY takes a positive count only for good fit; ignoring it");
+          }
+        }
+      }
+    }
+    env           = getenv("BF_STATS");
+    stats_at_exit = (env != NULL && atoi(env) != 0);
+    env           = getenv("BF_STATS_SIGNAL");
+    if (env != NULL && atoi(env) > 0) {
+      struct sigaction action = { .sa_handler = stats_signal_handler, .sa_flags = SA_RESTART };
+      sigemptyset(&action.sa_mask);
+      sigaction(atoi(env), &action, NULL);
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    slot_key      = ((uintptr_t)&now ^ (uint64_t)now.tv_nsec) * 0x9e3779b97f4a7c15 | 1;
+    env           = getenv("BF_PROFILE");
+    if (env != NULL && env[0] != '\0') {
+      const char* rate = getenv("BF_PROFILE_RATE");
+      heap_profile_init((rate != NULL && atol(rate) > 0) ? (size_t)atol(rate) : HEAP_PROFILE_DEFAULT_RATE,
+                        env);
+      profiling = true;
+      env       = getenv("BF_PROFILE_SIGNAL");
+      if (env != NULL && atoi(env) > 0) {
+        struct sigaction action = { .sa_handler = profile_signal_handler, .sa_flags = SA_RESTART };
+        sigemptyset(&action.sa_mask);
+        sigaction(atoi(env), &action, NULL);
+      }
+    }
+
+    for (unsigned int i = 0; i < num_arenas; i++) {
+      pthread_mutex_init(&arenas[i].lock, NULL);
+      arenas[i].index     = i;
+      arenas[i].tree_root = &arenas[i].tree_nil;
+    }
+    slab_region_init();
+    pthread_key_create(&tcache_key, tcache_flush_at_exit);
+    __atomic_store_n(&initialized, true, __ATOMIC_RELEASE);
+
+    // DEBUG: Emit a message to indicate that this allocator is being called.
+    DEBUG("bf-alloc initialized with arenas: ", num_arenas);
+
+  }
+  pthread_mutex_unlock(&init_lock);
+
+  // Registered outside the lock, since it may itself allocate.
+  if (first_time) {
+    pthread_atfork(lock_arenas_for_fork, unlock_arenas_after_fork, unlock_arenas_after_fork);
+  }
+
+} // init ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Choose the arena for the calling thread: the arena of its current CPU, or
+ * else the one it was assigned round-robin on its first allocation.
+ *
+ * \return The calling thread's arena.
+ */
+static arena_s* choose_arena () {
+
+  if (arena_by_cpu) {
+    int cpu = sched_getcpu();
+    return &arenas[(cpu < 0 ? 0 : cpu) % num_arenas];
+  }
+  if (thread_arena == NULL) {
+    thread_arena = &arenas[__atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % num_arenas];
+  }
+  return thread_arena;
+
+} // choose_arena ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Determine the size class of a block.
+ *
+ * \param size The size of the block, header included.
+ * \return     The index of the free list that holds blocks of that size.
+ */
+static int size_class (size_t size) {
+
+  // Small sizes map directly onto their exact class.
+  if (size <= MAX_SMALL_SIZE) {
+    return (int)(size / ALIGNMENT) - 1;
+  }
+
+  // Larger sizes fall in a power-of-two range (2^k, 2^(k+1)], which is split
+  // evenly into a few classes by the next bits below the top one.
+  int    log2  = 63 - __builtin_clzl(size - 1);
+  size_t split = ((size - 1) >> (log2 - RANGE_SPLIT_BITS)) & ((1 << RANGE_SPLIT_BITS) - 1);
+  int    class = NUM_SMALL_CLASSES +
+                 ((log2 - SMALL_SIZE_SHIFT) << RANGE_SPLIT_BITS) + (int)split;
+  return (class < NUM_SIZE_CLASSES) ? class : NUM_SIZE_CLASSES - 1;
+
+} // size_class ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Count blocks (or slots) of one size as newly in use, or as no longer in use.
+ * The arena's lock must be held.
+ *
+ * \param size  The size of the blocks, header included.
+ * \param count The number of blocks: positive if now in use, negative if not.
+ */
+static void count_in_use (arena_s* arena, size_t size, long count) {
+
+  alloc_class_stats_s* stats = &arena->class_stats[STATS_CLASS(size)];
+  stats->blocks_in_use += count;
+  stats->bytes_in_use  += count * (long)size;
+  arena->bytes_in_use  += count * (long)size;
+  if (arena->bytes_in_use > arena->peak_in_use) {
+    arena->peak_in_use = arena->bytes_in_use;
+  }
+
+} // count_in_use ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Count blocks (or slots) of one size as newly free, or as no longer free.
+ * The arena's lock must be held.
+ *
+ * \param size  The size of the blocks, header included.
+ * \param count The number of blocks: positive if now free, negative if not.
+ */
+static void count_free (arena_s* arena, size_t size, long count) {
+
+  alloc_class_stats_s* stats = &arena->class_stats[STATS_CLASS(size)];
+  stats->free_blocks += count;
+  stats->bytes_free  += count * (long)size;
+
+} // count_free ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Compare two tree nodes by size, then by address.
+ *
+ * \return `true` if `a` comes before `b`.
+ */
+static bool tree_less (tree_node_s* a, tree_node_s* b) {
+
+  size_t a_size = BLOCK_SIZE(a);
+  size_t b_size = BLOCK_SIZE(b);
+  return (a_size < b_size) || (a_size == b_size && a < b);
+
+} // tree_less ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Rotate the tree around a node: its child on the side opposite `dir` takes
+ * its place, and the node becomes that child's child on the `dir` side.
+ *
+ * \param node The node to rotate around.
+ * \param dir  0 to rotate left, 1 to rotate right.
+ */
+static void tree_rotate (arena_s* arena, tree_node_s* node, int dir) {
+
+  tree_node_s* nil   = &arena->tree_nil;
+  tree_node_s* pivot = node->child[!dir];
+
+  node->child[!dir] = pivot->child[dir];
+  if (pivot->child[dir] != nil) {
+    pivot->child[dir]->parent = node;
+  }
+  pivot->parent = node->parent;
+  if (node->parent == nil) {
+    arena->tree_root = pivot;
+  } else {
+    node->parent->child[node == node->parent->child[1]] = pivot;
+  }
+  pivot->child[dir] = node;
+  node->parent      = pivot;
+
+} // tree_rotate ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Insert a free block into the arena's tree, then restore the red-black
+ * invariants.
+ *
+ * \param node The block to insert.
+ */
+static void tree_insert (arena_s* arena, tree_node_s* node) {
+
+  tree_node_s* nil    = &arena->tree_nil;
+  tree_node_s* parent = nil;
+  tree_node_s* current = arena->tree_root;
+  while (current != nil) {
+    parent  = current;
+    current = current->child[!tree_less(node, current)];
+  }
+
+  node->parent   = parent;
+  node->child[0] = nil;
+  node->child[1] = nil;
+  node->red      = true;
+  if (parent == nil) {
+    arena->tree_root = node;
+  } else {
+    parent->child[!tree_less(node, parent)] = node;
+  }
+
+  // Fix any red node with a red parent, working up the tree.
+  while (node->parent->red) {
+    tree_node_s* parent      = node->parent;
+    tree_node_s* grandparent = parent->parent;
+    int          dir         = (parent == grandparent->child[1]);
+    tree_node_s* uncle       = grandparent->child[!dir];
+    if (uncle->red) {
+      parent->red      = false;
+      uncle->red       = false;
+      grandparent->red = true;
+      node             = grandparent;
+    } else {
+      if (node == parent->child[!dir]) {
+        node = parent;
+        tree_rotate(arena, node, dir);
+      }
+      node->parent->red = false;
+      grandparent->red  = true;
+      tree_rotate(arena, grandparent, !dir);
+    }
+  }
+  arena->tree_root->red = false;
+
+} // tree_insert ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Put one subtree in place of another, as the child of the latter's parent.
+ *
+ * \param old_node The root of the subtree to replace.
+ * \param new_node The root of the subtree to put in its place.
+ */
+static void tree_transplant (arena_s* arena, tree_node_s* old_node, tree_node_s* new_node) {
+
+  if (old_node->parent == &arena->tree_nil) {
+    arena->tree_root = new_node;
+  } else {
+    old_node->parent->child[old_node == old_node->parent->child[1]] = new_node;
+  }
+  new_node->parent = old_node->parent;
+
+} // tree_transplant ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find the leftmost (smallest) node of a subtree.
+ *
+ * \param node The root of the subtree; not the sentinel.
+ * \return     The subtree's first node.
+ */
+static tree_node_s* tree_min (arena_s* arena, tree_node_s* node) {
+
+  while (node->child[0] != &arena->tree_nil) {
+    node = node->child[0];
+  }
+  return node;
+
+} // tree_min ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Remove a block from the arena's tree, then restore the red-black
+ * invariants.
+ *
+ * \param node The block to remove.
+ */
+static void tree_remove (arena_s* arena, tree_node_s* node) {
+
+  tree_node_s* nil         = &arena->tree_nil;
+  tree_node_s* moved       = node;     // the node that leaves its position
+  bool         removed_red = node->red;
+  tree_node_s* fix;                    // the node that takes its place
+
+  if (node->child[0] == nil) {
+    fix = node->child[1];
+    tree_transplant(arena, node, node->child[1]);
+  } else if (node->child[1] == nil) {
+    fix = node->child[0];
+    tree_transplant(arena, node, node->child[0]);
+  } else {
+    // Replace the node with its successor, which has no left child.
+    moved       = tree_min(arena, node->child[1]);
+    removed_red = moved->red;
+    fix         = moved->child[1];
+    if (moved->parent == node) {
+      fix->parent = moved;
+    } else {
+      tree_transplant(arena, moved, moved->child[1]);
+      moved->child[1]         = node->child[1];
+      moved->child[1]->parent = moved;
+    }
+    tree_transplant(arena, node, moved);
+    moved->child[0]         = node->child[0];
+    moved->child[0]->parent = moved;
+    moved->red              = node->red;
+  }
+
+  if (removed_red) {
+    return; // no path lost a black node
+  }
+
+  // The path through `fix` is one black node short; push the shortfall up the
+  // tree until it can be absorbed.
+  while (fix != arena->tree_root && !fix->red) {
+    tree_node_s* parent  = fix->parent;
+    int          dir     = (fix == parent->child[1]);
+    tree_node_s* sibling = parent->child[!dir];
+    if (sibling->red) {
+      sibling->red = false;
+      parent->red  = true;
+      tree_rotate(arena, parent, dir);
+      sibling = parent->child[!dir];
+    }
+    if (!sibling->child[0]->red && !sibling->child[1]->red) {
+      sibling->red = true;
+      fix          = parent;
+    } else {
+      if (!sibling->child[!dir]->red) {
+        sibling->child[dir]->red = false;
+        sibling->red             = true;
+        tree_rotate(arena, sibling, !dir);
+        sibling = parent->child[!dir];
+      }
+      sibling->red              = parent->red;
+      parent->red               = false;
+      sibling->child[!dir]->red = false;
+      tree_rotate(arena, parent, dir);
+      fix = arena->tree_root;
+    }
+  }
+  fix->red = false;
+
+} // tree_remove ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find a fitting block in the arena's tree, by the fit policy.  Going down
+ * from the root, each fitting node passed is smaller than the last, so best
+ * fit goes all the way down, for the smallest block of at least `size` bytes
+ * (and of those, the one at the lowest address); first fit stops at the
+ * first fitting node, and good fit at the `good_fit_k`th.  Next fit takes the
+ * rover, the successor of the block it took last, if that fits.
+ *
+ * \param size The block size needed, header included.
+ * \return     The fitting block, or `NULL` if none is large enough.
+ */
+static header_s* tree_fit (arena_s* arena, size_t size) {
+
+  if (fit_policy == FIT_NEXT && arena->tree_rover != NULL) {
+    arena->probes++;
+    if (BLOCK_SIZE(arena->tree_rover) >= size) {
+      return (header_s*)arena->tree_rover; // its removal moves the rover on
+    }
+  }
+
+  tree_node_s* nil     = &arena->tree_nil;
+  tree_node_s* best    = NULL;
+  tree_node_s* current = arena->tree_root;
+  unsigned int fits    = 0;
+  while (current != nil) {
+    arena->probes++;
+    if (BLOCK_SIZE(current) >= size) {
+      best    = current; // it fits, but something to the left may fit better
+      current = current->child[0];
+      fits++;
+      if (fit_policy == FIT_FIRST || (fit_policy == FIT_GOOD && fits == good_fit_k)) {
+        break;
+      }
+    } else {
+      current = current->child[1];
+    }
+  }
+  if (fit_policy == FIT_NEXT) {
+    arena->tree_rover = best;
+  }
+  return (header_s*)best;
+
+} // tree_fit ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Step through the arena's tree in order.
+ *
+ * \param node The current node, or `NULL` to start at the smallest.
+ * \return     The next node, or `NULL` after the largest.
+ */
+static tree_node_s* tree_next (arena_s* arena, tree_node_s* node) {
+
+  tree_node_s* nil = &arena->tree_nil;
+  if (node == NULL) {
+    return (arena->tree_root == nil) ? NULL : tree_min(arena, arena->tree_root);
+  }
+  if (node->child[1] != nil) {
+    return tree_min(arena, node->child[1]);
+  }
+  while (node->parent != nil && node == node->parent->child[1]) {
+    node = node->parent;
+  }
+  return (node->parent == nil) ? NULL : node->parent;
+
+} // tree_next ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Push a block onto the head of the free list for its size class, or insert
+ * it into the tree if it is large.
+ *
+ * \param header_ptr The header of the block to insert.
+ */
+static void free_list_insert (arena_s* arena, header_s* header_ptr) {
+
+  count_free(arena, BLOCK_SIZE(header_ptr), 1);
+  if (BLOCK_SIZE(header_ptr) >= TREE_MIN_SIZE) {
+    tree_insert(arena, (tree_node_s*)header_ptr);
+    return;
+  }
+
+  int class = size_class(BLOCK_SIZE(header_ptr));
+
+  header_ptr->prev = NULL;
+  header_ptr->next = arena->free_lists[class];
+  if (header_ptr->next != NULL) {
+    header_ptr->next->prev = header_ptr;
+  }
+  arena->free_lists[class] = header_ptr;
+  arena->nonempty_classes[class / 64] |= (uint64_t)1 << (class % 64);
+
+} // free_list_insert ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Unlink a block from the free list for its size class, or remove it from the
+ * tree if it is large.
+ *
+ * \param header_ptr The header of the block to remove.
+ */
+static void free_list_remove (arena_s* arena, header_s* header_ptr) {
+
+  count_free(arena, BLOCK_SIZE(header_ptr), -1);
+  if (BLOCK_SIZE(header_ptr) >= TREE_MIN_SIZE) {
+    if (arena->tree_rover == (tree_node_s*)header_ptr) {
+      arena->tree_rover = tree_next(arena, arena->tree_rover);
+    }
+    tree_remove(arena, (tree_node_s*)header_ptr);
+    return;
+  }
+
+  int class = size_class(BLOCK_SIZE(header_ptr));
+  if (arena->rovers[class] == header_ptr) {
+    arena->rovers[class] = header_ptr->next;
+  }
+
+  if (header_ptr->prev == NULL) {
+    arena->free_lists[class] = header_ptr->next;
+  } else {
+    header_ptr->prev->next = header_ptr->next;
+  }
+  if (header_ptr->next != NULL) {
+    header_ptr->next->prev = header_ptr->prev;
+  }
+
+  if (arena->free_lists[class] == NULL) {
+    arena->nonempty_classes[class / 64] &= ~((uint64_t)1 << (class % 64));
+  }
+
+} // free_list_remove ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Turn a block into a free one of the given size: write its tag and footer,
+ * mark it in the tag of the block after it, and put it on its free list.  The
+ * block before it must be allocated (free neighbours are always coalesced),
+ * and the block after it must exist.
+ *
+ * \param header_ptr The header of the block.
+ * \param size       The size of the block, header included.
+ */
+static void make_free_block (arena_s* arena, header_s* header_ptr, size_t size) {
+
+  header_ptr->tag      = MAKE_TAG(size, arena->index, 0);
+  FOOTER(header_ptr)   = size;
+  SET_FLAG(NEXT_HEADER(header_ptr), PREV_FREE_FLAG);
+  free_list_insert(arena, header_ptr);
+
+} // make_free_block ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Shrink a block that is about to be allocated to `size` bytes, returning its
+ * tail to the free lists as a new block, if the tail is big enough to be
+ * worth keeping.  Since free neighbours are always coalesced, the block after
+ * the tail cannot be free, so the tail needs no coalescing of its own.
+ *
+ * \param header_ptr The header of the (allocated) block to split.
+ * \param size       The size to keep in the block, header included.
+ */
+static void split_block (arena_s* arena, header_s* header_ptr, size_t size) {
+
+  size_t block_size = BLOCK_SIZE(header_ptr);
+  if (block_size < size + MIN_BLOCK_SIZE) {
+    return; // the remainder would be too small to be useful
+  }
+
+  header_ptr->tag = MAKE_TAG(size, arena->index, header_ptr->tag & FLAG_MASK);
+  make_free_block(arena, NEXT_HEADER(header_ptr), block_size - size);
+
+} // split_block ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Merge a newly freed block with its free neighbours, if any, using the
+ * boundary tags to find them.  The neighbours are unlinked from their free
+ * lists; the merged block is not yet on any list, and its tag holds only its
+ * size.
+ *
+ * \param header_ptr The header of the block being freed.
+ * \return           The header of the merged block.
+ */
+static header_s* coalesce (arena_s* arena, header_s* header_ptr) {
+
+  size_t size = BLOCK_SIZE(header_ptr);
+
+  // Absorb the following block if it is free.  The last block of the current
+  // segment has the bump region after it instead, and the last of a retired
+  // segment has its fence, which is never free.
+  header_s* next_ptr = NEXT_HEADER(header_ptr);
+  if ((intptr_t)next_ptr != arena->free_addr && !HAS_FLAG(next_ptr, ALLOCATED_FLAG)) {
+    free_list_remove(arena, next_ptr);
+    size += BLOCK_SIZE(next_ptr);
+  }
+
+  // Let the preceding block absorb this one if it is free.
+  if (HAS_FLAG(header_ptr, PREV_FREE_FLAG)) {
+    header_s* prev_ptr = PREV_HEADER(header_ptr);
+    free_list_remove(arena, prev_ptr);
+    size      += BLOCK_SIZE(prev_ptr);
+    header_ptr = prev_ptr;
+  }
+
+  header_ptr->tag = size;
+  return header_ptr;
+
+} // coalesce ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find a fitting block on one size class's free list, by the fit policy.
+ * Best fit scans the whole list, unless it finds an exact fit; first fit
+ * stops at the first block that fits, and good fit at the `good_fit_k`th,
+ * taking the smallest seen.  Next fit starts from the list's rover, wrapping
+ * around to the head, and takes the first block that fits.
+ *
+ * \param class The size class whose list to search.
+ * \param size  The block size needed, header included.
+ * \return      A block on the list of at least `size` bytes, or `NULL` if
+ *              there is none.
+ */
+static header_s* fit_in_class (arena_s* arena, int class, size_t size) {
+
+  header_s* head      = arena->free_lists[class];
+  header_s* start     = head;
+  header_s* current   = head;
+  header_s* best      = NULL;
+  size_t    best_size = 0;
+  unsigned int fits   = 0;
+
+  // Every block in an exact class has the same size, so the head will do.
+  if (class < NUM_SMALL_CLASSES) {
+    arena->probes += (current != NULL);
+    return (current != NULL && BLOCK_SIZE(current) >= size) ? current : NULL;
+  }
+
+  if (fit_policy == FIT_NEXT && arena->rovers[class] != NULL) {
+    start   = arena->rovers[class];
+    current = start;
+  }
+
+  while (current != NULL) {
+
+    arena->probes++;
+    if (HAS_FLAG(current, ALLOCATED_FLAG)) {
+      ERROR("Allocated block on free list", (intptr_t)current); 
+    }
+
+    size_t current_size = BLOCK_SIZE(current);
+    if (size <= current_size && (best == NULL || current_size < best_size)) {
+      best      = current;
+      best_size = current_size;
+      fits++;
+      if (best_size == size || fit_policy == FIT_FIRST || fit_policy == FIT_NEXT ||
+          (fit_policy == FIT_GOOD && fits == good_fit_k)) {
+        break; // an exact fit cannot be beaten, and the rest settle for less
+      }
+    }
+
+    // next fit wraps around from the tail to the head, and stops where it began
+    current = current->next;
+    if (current == NULL && start != head) {
+      current = head;
+    }
+    if (current == start) {
+      break;
+    }
+
+  }
+
+  if (fit_policy == FIT_NEXT && best != NULL) {
+    arena->rovers[class] = best; // its removal moves the rover on
+  }
+  return best;
+
+} // fit_in_class ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find a fitting free block for a request.  Large requests go straight to the
+ * tree.  Otherwise, only the request's own size class is searched block by
+ * block; failing that, any block in the next non-empty larger class fits,
+ * and the best of them is the best fit overall, since every block there is
+ * larger than any block in the classes below it.  Failing that, the tree is
+ * searched.  Within a list or the tree, the fit policy picks the block.
+ *
+ * \param size The block size needed, header included.
+ * \return     A fitting free block, or `NULL` if no block is large enough.
+ */
+static header_s* find_fit (arena_s* arena, size_t size) {
+
+  if (size >= TREE_MIN_SIZE) {
+    return tree_fit(arena, size);
+  }
+
+  int       class = size_class(size);
+  header_s* best  = fit_in_class(arena, class, size);
+  if (best != NULL) {
+    return best;
+  }
+
+  // Look for the next non-empty class above the request's class.
+  for (int first = class + 1; first < NUM_SIZE_CLASSES; first = (first / 64 + 1) * 64) {
+    uint64_t larger = arena->nonempty_classes[first / 64] & (~(uint64_t)0 << (first % 64));
+    if (larger != 0) {
+      return fit_in_class(arena, (first / 64) * 64 + __builtin_ctzl(larger), size);
+    }
+  }
+  return tree_fit(arena, size);
+
+} // find_fit ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Return an arena's free memory to the OS: the pages inside free blocks (but
+ * not the blocks' metadata at either end), the bump region's pages touched
+ * since the last purge, and its empty slabs.  With huge pages, only whole
+ * huge pages are given back, so that none is broken up.  The memory stays
+ * mapped, and is zero-filled when next touched.  The arena's lock must be
+ * held.
+ *
+ * \param arena The arena to purge.
+ */
+static void arena_purge (arena_s* arena) {
+
+  // Only blocks spanning at least a page beyond their metadata can give any
+  // pages back, and those are all in the tree.
+  for (tree_node_s* current = tree_next(arena, NULL); current != NULL; current = tree_next(arena, current)) {
+    intptr_t start = PURGE_UP((intptr_t)current + (intptr_t)sizeof(tree_node_s));
+    intptr_t end   = PURGE_DOWN((intptr_t)NEXT_HEADER(current) - (intptr_t)sizeof(size_t));
+    if (!HAS_FLAG(current, PURGED_FLAG) && start < end) {
+      madvise((void*)start, end - start, MADV_DONTNEED);
+      current->tag |= PURGED_FLAG;
+    }
+  }
+
+  intptr_t bump_start = PURGE_UP(arena->free_addr);
+  intptr_t bump_end   = PURGE_UP(arena->dirty_end);
+  if (bump_start < bump_end) {
+    madvise((void*)bump_start, bump_end - bump_start, MADV_DONTNEED);
+  }
+  arena->dirty_end = bump_start;
+
+  for (slab_s* slab = arena->empty_slabs; slab != NULL; slab = slab->next) {
+    if (slab->purged) {
+      continue;
+    }
+    if (!huge_pages) {
+      madvise((void*)SLAB_BASE(slab), SLAB_SIZE, MADV_DONTNEED);
+      slab->purged = true;
+      continue;
+    }
+
+    // Only give back the huge page once none of its slabs are in use; they
+    // all belong to this arena.  Those never handed out have no slot size.
+    slab_s* first = &slab_table[(size_t)(slab - slab_table) & ~(SLABS_PER_HUGE_PAGE - 1)];
+    bool    empty = true;
+    for (size_t i = 0; i < SLABS_PER_HUGE_PAGE && empty; i++) {
+      empty = (first[i].slot_size == 0 || first[i].free_slots == first[i].num_slots);
+    }
+    if (empty) {
+      madvise((void*)SLAB_BASE(first), HUGE_PAGE_SIZE, MADV_DONTNEED);
+      for (size_t i = 0; i < SLABS_PER_HUGE_PAGE; i++) {
+        first[i].purged = true;
+      }
+    }
+  }
+
+} // arena_purge ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Purge an arena if its free memory has had `decay_ms` to be reused since the
+ * last purge.  Spacing the purges out keeps memory that is freed and reused
+ * quickly from being handed back and forth with the OS.  The arena's lock must
+ * be held.
+ *
+ * \param arena The arena that has just freed memory.
+ */
+static void arena_decay (arena_s* arena) {
+
+  if (decay_ms < 0) {
+    return; // purging is turned off
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  long now_ms = now.tv_sec * 1000 + now.tv_nsec / 1000000;
+  if (now_ms - arena->last_purge_ms >= decay_ms) {
+    arena_purge(arena);
+    arena->last_purge_ms = now_ms;
+  }
+
+} // arena_decay ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Commit more of an arena's current segment, in `COMMIT_SIZE` steps, so that
+ * it is accessible up to `addr`.  The arena's lock must be held.
+ *
+ * \param arena The arena whose segment is to be committed.
+ * \param addr  The address up to which the segment is needed.
+ * \return      `true` if successful; `false` if the memory could not be committed.
+ */
+static bool arena_commit (arena_s* arena, intptr_t addr) {
+
+  intptr_t segment_end = arena->end_addr + HEADER_SIZE;
+  intptr_t commit_end  = arena->start_addr +
+                         (intptr_t)(((size_t)(addr - arena->start_addr) + COMMIT_SIZE - 1) & ~(COMMIT_SIZE - 1));
+  if (commit_end > segment_end) {
+    commit_end = segment_end;
+  }
+  if (mprotect((void*)arena->commit_end, commit_end - arena->commit_end, PROT_READ | PROT_WRITE) != 0) {
+    return false;
+  }
+  arena->commit_end = commit_end;
+  return true;
+
+} // arena_commit ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Give an arena a new segment, big enough for a block of `size` bytes, to bump
+ * through.  A segment is only reserved here; it is committed as it is used.
+ * The current segment, if any, is retired: what is left of it becomes a free
+ * block, and a _fence_, a permanently allocated tag after its last block,
+ * keeps coalescing from running off its end.  The arena's lock must be held.
+ *
+ * \param arena The arena that needs a new segment.
+ * \param size  The size of the block that did not fit, header included.
+ * \return      `true` if successful; `false` if no segment could be mapped.
+ */
+static bool arena_add_segment (arena_s* arena, size_t size) {
+
+  size_t segment_size = (arena->segment_size == 0) ? MIN_SEGMENT_SIZE : arena->segment_size;
+  if (segment_size < size + ALIGNMENT) {
+    segment_size = SEGMENT_UP(size + ALIGNMENT);
+  }
+
+  // The rest of the current segment must be accessible before it becomes a
+  // free block (with its footer at the end) and gets its fence.
+  if (arena->start_addr != 0 && !arena_commit(arena, arena->end_addr + HEADER_SIZE)) {
+    return false;
+  }
+  void* segment = map_region(segment_size, SEGMENT_ALIGN, PROT_NONE);
+  if (segment == MAP_FAILED) {
+    return false;
+  }
+  for (size_t span = (uintptr_t)segment >> SEGMENT_SHIFT;
+       span < ((uintptr_t)segment + segment_size) >> SEGMENT_SHIFT;
+       span++) {
+    segment_table[span] = (uint8_t)(arena->index + 1);
+  }
+
+  // Retire the current segment, fencing off its last block, or the tail
+  // after it if that is big enough to be a block.
+  header_s* tail_ptr  = NULL;
+  size_t    tail_size = arena->end_addr - arena->free_addr;
+  if (arena->start_addr != 0) {
+    tail_ptr = (header_s*)arena->free_addr;
+    if (tail_size >= MIN_BLOCK_SIZE) {
+      tail_ptr->tag                     = MAKE_TAG(tail_size, arena->index, ALLOCATED_FLAG);
+      ((header_s*)arena->end_addr)->tag = MAKE_TAG(0, arena->index, ALLOCATED_FLAG);
+    } else {
+      tail_ptr->tag = MAKE_TAG(0, arena->index, ALLOCATED_FLAG);
+      tail_ptr      = NULL;
+    }
+    arena->retired_bytes += arena->end_addr + HEADER_SIZE - arena->start_addr;
+  }
+
+  arena->start_addr   = (intptr_t)segment;
+  arena->end_addr     = arena->start_addr + segment_size - HEADER_SIZE;
+  arena->commit_end   = arena->start_addr;
+  arena->free_addr    = arena->start_addr + ALIGNMENT - HEADER_SIZE;
+  arena->dirty_end    = arena->free_addr;
+  arena->high_water   = arena->free_addr;
+  arena->segment_size = (segment_size < MAX_SEGMENT_SIZE / 2) ? segment_size * 2 : MAX_SEGMENT_SIZE;
+
+  // The tail is counted as a block in use, so that freeing it balances out.
+  if (tail_ptr != NULL) {
+    count_in_use(arena, tail_size, 1);
+    heap_free(arena, tail_ptr);
+  }
+  return true;
+
+} // arena_add_segment ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a block of `size` bytes from an arena.  Specifically, search the
+ * arena's segregated free lists, choosing the _best fit_.  If no such block is
+ * available, expand into the arena's region via _pointer bumping_.  The
+ * arena's lock must be held.
+ *
+ * \param arena  The arena to allocate from.
+ * \param size   The size of the block to allocate, header included.
+ * \param zeroed If not `NULL`, set to `true` if the block is known to be all
+ *               zero, being bumped from memory untouched since it was mapped
+ *               or purged.
+ * \return A pointer to the allocated block, if successful; `NULL` if unsuccessful.
+ */
+static void* heap_malloc (arena_s* arena, size_t size, bool* zeroed) {
+
+  arena->searches++;
+  header_s* best = find_fit(arena, size); // search only the lists that can hold size
+
+  void* new_block_ptr = NULL;
+  if (best != NULL) { // allocate from best fit block if available otherwise use pointer bumping
+
+    free_list_remove(arena, best); // unlink best from its size class's free list
+
+    // the block before a free block is never free, so no PREV_FREE flag here
+    best->tag = MAKE_TAG(BLOCK_SIZE(best), arena->index, ALLOCATED_FLAG);
+    CLEAR_FLAG(NEXT_HEADER(best), PREV_FREE_FLAG);
+    split_block(arena, best, size); // give back whatever the request does not need
+    new_block_ptr = HEADER_TO_BLOCK(best); // update block pointer
+    
+  } else { // no suitable block found in free list, use pointer bumping
+
+    // make sure the block fits before touching any metadata, moving on to a
+    // new segment if it does not, and that its memory is committed
+    intptr_t new_free_addr = arena->free_addr + size;
+    if (new_free_addr > arena->end_addr) {
+      if (!arena_add_segment(arena, size)) {
+        return NULL; // no more address space
+      }
+      new_free_addr = arena->free_addr + size;
+    }
+    if (new_free_addr > arena->commit_end && !arena_commit(arena, new_free_addr)) {
+      return NULL;
+    }
+
+    // blocks are contiguous (and multiples of 16 bytes) so that each one can
+    // find its neighbours, so the arena's free_addr stays 8 bytes past an
+    // aligned address here
+    header_s* header_ptr = (header_s*)arena->free_addr; // create a new block at the current free
+    arena->free_addr     = new_free_addr; // set free addy to be new free addy
+    if (zeroed != NULL) {
+      *zeroed = ((intptr_t)header_ptr >= arena->dirty_end); // untouched since mapped or purged
+    }
+    if (new_free_addr > arena->dirty_end) {
+      arena->dirty_end = new_free_addr; // remember how far the pages have been touched
+    }
+    if (new_free_addr > arena->high_water) {
+      arena->high_water = new_free_addr;
+    }
+
+    // the last block is never free (it goes back to the bump region instead)
+    header_ptr->tag = MAKE_TAG(size, arena->index, ALLOCATED_FLAG);
+    new_block_ptr   = HEADER_TO_BLOCK(header_ptr);
+  }
+
+  count_in_use(arena, BLOCK_SIZE(BLOCK_TO_HEADER(new_block_ptr)), 1);
+  return new_block_ptr; // return addy of the new block
+
+} // heap_malloc()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Return a block to its arena.  Coalesce the given block with its free
+ * neighbours and add the result to the free list for its size class, or
+ * return it to the bump region if it is the last block.  The arena's lock must
+ * be held.
+ *
+ * \param arena      The arena that owns the block.
+ * \param header_ptr The header of the block to be deallocated.
+ */
+static void heap_free (arena_s* arena, header_s* header_ptr) {
+
+  count_in_use(arena, BLOCK_SIZE(header_ptr), -1);
+  header_ptr = coalesce(arena, header_ptr); // merge with any free neighbours
+
+  if ((intptr_t)NEXT_HEADER(header_ptr) == arena->free_addr) {
+    arena->free_addr = (intptr_t)header_ptr; // the last block goes back to the bump region
+  } else {
+    make_free_block(arena, header_ptr, BLOCK_SIZE(header_ptr)); // push the freed block onto its size class's free list
+  }
+  arena_decay(arena); // give long-unused memory back to the OS
+
+}
+// heap_free()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Shrink an allocated block to `size` bytes, freeing its tail (which may then
+ * coalesce with a free block after it, or return to the bump region) if the
+ * tail is big enough to be a block.  The arena's lock must be held.
+ *
+ * \param arena      The arena that owns the block.
+ * \param header_ptr The header of the block to shrink.
+ * \param size       The size to keep in the block, header included.
+ */
+static void shrink_block (arena_s* arena, header_s* header_ptr, size_t size) {
+
+  size_t block_size = BLOCK_SIZE(header_ptr);
+  if (block_size < size + MIN_BLOCK_SIZE) {
+    return; // the tail would be too small to be a block
+  }
+
+  header_ptr->tag    = MAKE_TAG(size, arena->index, header_ptr->tag & FLAG_MASK);
+  header_s* tail_ptr = NEXT_HEADER(header_ptr);
+  tail_ptr->tag      = MAKE_TAG(block_size - size, arena->index, ALLOCATED_FLAG);
+
+  // Count the tail as a block in use, so that freeing it balances out.
+  count_in_use(arena, block_size, -1);
+  count_in_use(arena, size, 1);
+  count_in_use(arena, block_size - size, 1);
+  heap_free(arena, tail_ptr);
+
+} // shrink_block ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Resize an allocated block in place, if possible.  A block shrinks by freeing
+ * its tail.  It grows into the bump region if it is the last block, or else by
+ * absorbing the free block after it, if that is large enough.  The arena's
+ * lock must be held.
+ *
+ * \param arena      The arena that owns the block.
+ * \param header_ptr The header of the block to resize.
+ * \param size       The new size of the block, header included.
+ * \return           `true` if the block now has the new size (or close to
+ *                   it); `false` if it could not grow and is unchanged.
+ */
+static bool heap_resize (arena_s* arena, header_s* header_ptr, size_t size) {
+
+  size_t    block_size = BLOCK_SIZE(header_ptr);
+  header_s* next_ptr   = NEXT_HEADER(header_ptr);
+
+  if (size <= block_size) {
+    shrink_block(arena, header_ptr, size);
+    return true;
+  }
+
+  if ((intptr_t)next_ptr == arena->free_addr) {
+    // The last block: just move the bump pointer.
+    intptr_t new_free_addr = (intptr_t)header_ptr + size;
+    if (new_free_addr > arena->end_addr ||
+        (new_free_addr > arena->commit_end && !arena_commit(arena, new_free_addr))) {
+      return false;
+    }
+    arena->free_addr = new_free_addr;
+    if (new_free_addr > arena->dirty_end) {
+      arena->dirty_end = new_free_addr;
+    }
+    if (new_free_addr > arena->high_water) {
+      arena->high_water = new_free_addr;
+    }
+    header_ptr->tag = MAKE_TAG(size, arena->index, header_ptr->tag & FLAG_MASK);
+    count_in_use(arena, block_size, -1);
+    count_in_use(arena, size, 1);
+    return true;
+  }
+
+  if (!HAS_FLAG(next_ptr, ALLOCATED_FLAG) && block_size + BLOCK_SIZE(next_ptr) >= size) {
+    // Absorb the free block after it, then give back what is not needed.  A
+    // free block never ends at the bump region, so another block follows it.
+    free_list_remove(arena, next_ptr);
+    count_in_use(arena, block_size, -1);
+    block_size += BLOCK_SIZE(next_ptr);
+    count_in_use(arena, block_size, 1);
+    header_ptr->tag = MAKE_TAG(block_size, arena->index, header_ptr->tag & FLAG_MASK);
+    CLEAR_FLAG(NEXT_HEADER(header_ptr), PREV_FREE_FLAG);
+    shrink_block(arena, header_ptr, size);
+    return true;
+  }
+
+  return false;
+
+} // heap_resize ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a block whose payload has a larger alignment than `ALIGNMENT`.  A
+ * block with room for the alignment to spare is taken, and the part before
+ * the aligned payload is split off and freed, as is any tail beyond the
+ * request, so that little more than the request stays allocated.  The
+ * arena's lock must be held.
+ *
+ * \param arena     The arena to allocate from.
+ * \param alignment The payload's alignment: a power of two, above `ALIGNMENT`.
+ * \param size      The size of the block to allocate, header included.
+ * \return          A pointer to the allocated block, if successful; `NULL` if
+ *                  unsuccessful.
+ */
+static void* heap_memalign (arena_s* arena, size_t alignment, size_t size) {
+
+  // Leave room for a free block in front of the aligned payload.
+  void* block_ptr = heap_malloc(arena, size + alignment + MIN_BLOCK_SIZE, NULL);
+  if (block_ptr == NULL) {
+    return NULL;
+  }
+  header_s* header_ptr = BLOCK_TO_HEADER(block_ptr);
+
+  if (((intptr_t)block_ptr & (alignment - 1)) != 0) {
+    // Split the block at the first aligned payload far enough in for the
+    // part before it to be a block, and free that part.  The block has just
+    // been allocated, so the one before it is not free.
+    intptr_t  aligned    = ((intptr_t)block_ptr + MIN_BLOCK_SIZE + alignment - 1) & ~(intptr_t)(alignment - 1);
+    header_s* lead_ptr   = header_ptr;
+    size_t    block_size = BLOCK_SIZE(lead_ptr);
+    size_t    lead_size  = (intptr_t)BLOCK_TO_HEADER(aligned) - (intptr_t)lead_ptr;
+    header_ptr           = BLOCK_TO_HEADER(aligned);
+    lead_ptr->tag        = MAKE_TAG(lead_size, arena->index, ALLOCATED_FLAG);
+    header_ptr->tag      = MAKE_TAG(block_size - lead_size, arena->index, ALLOCATED_FLAG);
+
+    // Count the lead as a block in use, so that freeing it balances out.
+    count_in_use(arena, block_size, -1);
+    count_in_use(arena, lead_size, 1);
+    count_in_use(arena, block_size - lead_size, 1);
+    heap_free(arena, lead_ptr);
+  }
+
+  shrink_block(arena, header_ptr, size);
+  return HEADER_TO_BLOCK(header_ptr);
+
+} // heap_memalign ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Push a slab onto the head of its class's partial list.  The arena's lock
+ * must be held.
+ *
+ * \param slab The slab to insert.
+ */
+static void slab_link (arena_s* arena, slab_s* slab) {
+
+  int class  = size_class(slab->slot_size);
+  slab->prev = NULL;
+  slab->next = arena->partial_slabs[class];
+  if (slab->next != NULL) {
+    slab->next->prev = slab;
+  }
+  arena->partial_slabs[class] = slab;
+
+} // slab_link ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Unlink a slab from its class's partial list.  The arena's lock must be held.
+ *
+ * \param slab The slab to remove.
+ */
+static void slab_unlink (arena_s* arena, slab_s* slab) {
+
+  if (slab->prev == NULL) {
+    arena->partial_slabs[size_class(slab->slot_size)] = slab->next;
+  } else {
+    slab->prev->next = slab->next;
+  }
+  if (slab->next != NULL) {
+    slab->next->prev = slab->prev;
+  }
+
+} // slab_unlink ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take a slab for the given class, reusing one of the arena's empty slabs if it
+ * has any and otherwise handing out a fresh one from the slab region, and put
+ * it on the class's partial list.  Reusing empty slabs first keeps the slabs
+ * in use packed into as few (huge) pages as possible.  The arena's lock must
+ * be held.
+ *
+ * \param arena     The arena that will own the slab.
+ * \param slot_size The size of the slab's slots.
+ * \return          The slab, or `NULL` if the slab region is exhausted.
+ */
+static slab_s* slab_create (arena_s* arena, size_t slot_size) {
+
+  slab_s* slab = arena->empty_slabs;
+  if (slab != NULL) {
+    arena->empty_slabs = slab->next;
+  } else {
+    size_t index;
+    if (huge_pages) {
+      // Take fresh slabs a huge page at a time, so that no other arena's
+      // slabs share the huge page, and it can be purged as a whole.
+      if (arena->slab_run_next == arena->slab_run_end) {
+        arena->slab_run_next = __atomic_fetch_add(&slabs_used, SLABS_PER_HUGE_PAGE, __ATOMIC_RELAXED);
+        arena->slab_run_end  = arena->slab_run_next + SLABS_PER_HUGE_PAGE;
+      }
+      index = arena->slab_run_next++;
+    } else {
+      index = __atomic_fetch_add(&slabs_used, 1, __ATOMIC_RELAXED);
+    }
+    if (slab_table == NULL || index >= SLAB_REGION_SIZE / SLAB_SIZE) {
+      return NULL;
+    }
+    slab = &slab_table[index];
+  }
+
+  slab->slot_size       = slot_size;
+  slab->slot_reciprocal = (uint32_t)(((uint64_t)1 << 32) / slot_size + 1);
+  slab->num_slots       = SLAB_SIZE / slot_size;
+  slab->free_slots      = slab->num_slots;
+  slab->arena           = arena->index;
+  slab->purged          = false;
+
+  // Mark every slot free; the bits past the last slot stay clear.
+  for (int word = 0; word < SLAB_MAP_WORDS; word++) {
+    int bits = slab->num_slots - word * 64;
+    slab->free_map[word] = (bits >= 64) ? ~(uint64_t)0 :
+                           (bits <= 0)  ? 0 : ((uint64_t)1 << bits) - 1;
+  }
+
+  slab_link(arena, slab);
+  count_free(arena, slot_size, slab->num_slots);
+  return slab;
+
+} // slab_create ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate up to `n` slots of `size` bytes from the arena's slabs of that
+ * class, taking new slabs as those with free slots run out.  Each slab's free
+ * slots are taken a bitmap word at a time, and counted all at once.  The
+ * arena's lock must be held.
+ *
+ * \param arena The arena to allocate from.
+ * \param size  The (aligned) slot size, no more than `MAX_SLAB_SIZE`.
+ * \param n     The number of slots wanted.
+ * \param out   Where to store the slots.
+ * \return      The number of slots allocated, which is less than `n` only if
+ *              the slab region is exhausted.
+ */
+static size_t slab_malloc_batch (arena_s* arena, size_t size, size_t n, void** out) {
+
+  int    class = size_class(size);
+  size_t count = 0;
+  while (count < n) {
+
+    slab_s* slab = arena->partial_slabs[class];
+    if (slab == NULL) {
+      slab = slab_create(arena, size);
+      if (slab == NULL) {
+        break;
+      }
+    }
+
+    // Take the lowest free slots.
+    uintptr_t base  = SLAB_BASE(slab);
+    size_t    taken = 0;
+    for (int word = 0; word < SLAB_MAP_WORDS && count + taken < n; word++) {
+      uint64_t map = slab->free_map[word];
+      while (map != 0 && count + taken < n) {
+        int slot = word * 64 + __builtin_ctzl(map);
+        map     &= map - 1;
+        out[count + taken++] = (void*)(base + (uintptr_t)slot * slab->slot_size);
+      }
+      slab->free_map[word] = map;
+    }
+    slab->free_slots -= taken;
+    count_free(arena, slab->slot_size, -(long)taken);
+    count_in_use(arena, slab->slot_size, taken);
+    count += taken;
+
+    if (slab->free_slots == 0) {
+      slab_unlink(arena, slab); // full slabs are on no list
+    }
+
+  }
+  return count;
+
+} // slab_malloc_batch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a slot of `size` bytes from one of the arena's slabs of that
+ * class, taking a new slab if none has a free slot.  The arena's lock must be
+ * held.
+ *
+ * \param arena The arena to allocate from.
+ * \param size  The (aligned) slot size, no more than `MAX_SLAB_SIZE`.
+ * \return      A pointer to the slot, if successful; `NULL` if the slab
+ *              region is exhausted.
+ */
+static void* slab_malloc (arena_s* arena, size_t size) {
+
+  void* ptr = NULL;
+  slab_malloc_batch(arena, size, 1, &ptr);
+  return ptr;
+
+} // slab_malloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Return a slot to its slab.  A slab that was full goes back on its partial
+ * list; one that becomes entirely free moves to the arena's empty slabs.  The
+ * lock of the arena that owns the slab must be held.
+ *
+ * \param arena The arena that owns the slab.
+ * \param slab  The slot's slab.
+ * \param ptr   The slot to free.
+ */
+static void slab_free (arena_s* arena, slab_s* slab, void* ptr) {
+
+  uint32_t slot = SLOT_INDEX(slab, (uintptr_t)ptr - SLAB_BASE(slab));
+  slab->free_map[slot / 64] |= (uint64_t)1 << (slot % 64);
+  SLOT_KEY(ptr) = 0; // its map now says it is free, and it may be handed out
+  slab->free_slots++;
+  count_in_use(arena, slab->slot_size, -1);
+  count_free(arena, slab->slot_size, 1);
+
+  if (slab->free_slots == 1) {
+    slab_link(arena, slab); // it was full, so on no list
+  }
+
+  if (slab->free_slots == slab->num_slots) {
+    // An empty slab belongs to no class until it is taken again.
+    count_free(arena, slab->slot_size, -(long)slab->num_slots);
+    slab_unlink(arena, slab);
+    slab->next         = arena->empty_slabs;
+    arena->empty_slabs = slab;
+    arena_decay(arena);
+  }
+
+} // slab_free ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Free a slot or block into the arena that owns it.  The arena's lock must be
+ * held.
+ *
+ * \param arena The arena that owns the slot or block.
+ * \param ptr   The slot or block to free, which may be marked `CACHED_FLAG`.
+ */
+static void arena_free (arena_s* arena, void* ptr) {
+
+  if (IS_SLAB_PTR(ptr)) {
+    slab_free(arena, SLAB_OF(ptr), ptr);
+  } else {
+    header_s* header_ptr = BLOCK_TO_HEADER(ptr);
+    header_ptr->tag     &= ~CACHED_FLAG;
+    heap_free(arena, header_ptr);
+  }
+
+} // arena_free ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Push a chain of slots or blocks freed by a thread of another arena onto
+ * their owner's remote-free list, spliced in whole, without taking the
+ * owner's lock.  Slots must already carry `slot_key` and blocks be marked
+ * `CACHED_FLAG`, so that freeing them again is caught meanwhile.
+ *
+ * \param arena The arena that owns the slots or blocks.
+ * \param first The first slot or block of the chain, each linked to the next
+ *              through its first word.
+ * \param last  The last slot or block of the chain (`first`, for just one).
+ */
+static void remote_free_push (arena_s* arena, void* first, void* last) {
+
+  void* head = __atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED);
+  do {
+    *(void**)last = head;
+  } while (!__atomic_compare_exchange_n(&arena->remote_frees, &head, first, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+} // remote_free_push ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take the whole of an arena's remote-free list and free everything on it.
+ * Only the arena's lock holder takes the list, so the lock-free list has a
+ * single consumer.  The arena's lock must be held.
+ *
+ * \param arena The arena whose remote frees to drain.
+ */
+static void remote_free_drain (arena_s* arena) {
+
+  if (__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED) == NULL) {
+    return;
+  }
+  void* ptr = __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_ACQUIRE);
+  while (ptr != NULL) {
+    void* next = *(void**)ptr;
+    arena_free(arena, ptr);
+    ptr = next;
+  }
+
+} // remote_free_drain ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Free a slot or block that is not to be cached.  One of the calling
+ * thread's own arena is freed under the lock, along with the arena's remote
+ * frees; one of another arena is pushed onto that arena's remote-free list.
+ *
+ * \param owner The arena that owns the slot or block.
+ * \param ptr   The slot or block to free.
+ */
+static void arena_free_from_thread (arena_s* owner, void* ptr) {
+
+  if (owner != choose_arena()) {
+    if (IS_SLAB_PTR(ptr)) {
+      SLOT_KEY(ptr) = slot_key;
+    } else {
+      SET_FLAG(BLOCK_TO_HEADER(ptr), CACHED_FLAG);
+    }
+    remote_free_push(owner, ptr, ptr);
+    return;
+  }
+
+  pthread_mutex_lock(&owner->lock);
+  remote_free_drain(owner);
+  arena_free(owner, ptr);
+  pthread_mutex_unlock(&owner->lock);
+
+} // arena_free_from_thread ()
+// ==============================================================================
+
+
+
+
+// ==============================================================================
+/**
+ * Make sure this thread's tcache is flushed when the thread exits.  Must be
+ * called without the heap lock, since registering may allocate.
+ *
+ * \return `true` if the tcache may be used by this thread.
+ */
+static bool tcache_ready () {
+
+  if (!tcache.registered) {
+    tcache.registered = true;
+    pthread_setspecific(tcache_key, &tcache);
+  }
+  return !tcache.disabled;
+
+} // tcache_ready ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Push a block or slot onto one of this thread's tcache bins, linking it
+ * through its first word.  Blocks must already be marked `CACHED_FLAG`; slots
+ * are given `slot_key`.
+ *
+ * \param class The bin to push onto.
+ * \param ptr   The block or slot.
+ */
+static void tcache_push (int class, void* ptr) {
+
+  if (class < NUM_SLAB_CLASSES) {
+    SLOT_KEY(ptr) = slot_key;
+  }
+  *(void**)ptr       = tcache.bins[class];
+  tcache.bins[class] = ptr;
+  tcache.counts[class]++;
+
+} // tcache_push ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Pop the most recently cached block or slot from one of this thread's
+ * tcache bins, which must not be empty.  A slot loses its `slot_key`.
+ *
+ * \param class The bin to pop from.
+ * \return      The block or slot.
+ */
+static void* tcache_pop (int class) {
+
+  void* ptr          = tcache.bins[class];
+  tcache.bins[class] = *(void**)ptr;
+  tcache.counts[class]--;
+  if (class < NUM_SLAB_CLASSES) {
+    SLOT_KEY(ptr) = 0;
+  }
+  return ptr;
+
+} // tcache_pop ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Return the `count` most recently cached blocks of one bin to their arenas.
+ * Those of this thread's own arena are freed under a single hold of its lock;
+ * those of other arenas go onto their remote-free lists.  Slots go back to
+ * their slabs; blocks are coalesced as usual.
+ *
+ * \param class The size class of the bin.
+ * \param count The number of blocks to return.
+ */
+static void tcache_drain (int class, unsigned int count) {
+
+  arena_s* local  = choose_arena();
+  bool     locked = false;
+  while (count > 0 && tcache.bins[class] != NULL) {
+    void*    ptr   = tcache_pop(class);
+    arena_s* owner = (class < NUM_SLAB_CLASSES) ? &arenas[SLAB_OF(ptr)->arena] :
+                                                  &arenas[BLOCK_ARENA(BLOCK_TO_HEADER(ptr))];
+    if (owner != local) {
+      if (class < NUM_SLAB_CLASSES) {
+        SLOT_KEY(ptr) = slot_key; // blocks are still marked as cached
+      }
+      remote_free_push(owner, ptr, ptr);
+    } else {
+      if (!locked) {
+        pthread_mutex_lock(&local->lock);
+        remote_free_drain(local);
+        locked = true;
+      }
+      arena_free(local, ptr);
+    }
+    count--;
+  }
+  if (locked) {
+    pthread_mutex_unlock(&local->lock);
+  }
+
+} // tcache_drain ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Flush this thread's tcache back to the arenas as the thread exits.
+ *
+ * \param unused The key's value (this thread's tcache).
+ */
+static void tcache_flush_at_exit (void* unused) {
+
+  for (int class = 0; class < NUM_SMALL_CLASSES; class++) {
+    tcache_drain(class, tcache.counts[class]);
+  }
+
+  // Any later frees by this thread (e.g., from other destructors) go straight
+  // to the arenas.
+  tcache.disabled = true;
+
+} // tcache_flush_at_exit ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a slot or block from an arena, according to its size.  The arena's
+ * lock must be held.
+ *
+ * \param arena  The arena to allocate from.
+ * \param size   The slot size, if no more than `MAX_SLAB_SIZE`; otherwise the
+ *               block size, header included.
+ * \param zeroed As for `heap_malloc()`; slots are never known to be zero.
+ * \return       A pointer to the slot or block, if successful; `NULL` if
+ *               unsuccessful.
+ */
+static void* arena_alloc (arena_s* arena, size_t size, bool* zeroed) {
+
+  return (size <= MAX_SLAB_SIZE) ? slab_malloc(arena, size) : heap_malloc(arena, size, zeroed);
+
+} // arena_alloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate up to `n` slots or blocks of one size from an arena, falling back
+ * on blocks if the slab region is exhausted.  The arena's lock must be held.
+ *
+ * \param arena The arena to allocate from.
+ * \param size  The slot size, if no more than `MAX_SLAB_SIZE`; otherwise the
+ *              block size, header included.
+ * \param n     The number wanted.
+ * \param out   Where to store the slots or blocks.
+ * \return      The number allocated, which is less than `n` only if the
+ *              arena cannot map another segment.
+ */
+static size_t arena_alloc_batch (arena_s* arena, size_t size, size_t n, void** out) {
+
+  size_t count = 0;
+  if (size <= MAX_SLAB_SIZE) {
+    count = slab_malloc_batch(arena, size, n, out);
+    size  = REQUEST_TO_BLOCK_SIZE(size); // for any the slab region cannot hold
+  }
+  while (count < n && (out[count] = heap_malloc(arena, size, NULL)) != NULL) {
+    count++;
+  }
+  return count;
+
+} // arena_alloc_batch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate from the calling thread's arena, falling back on the other arenas
+ * if it cannot map another segment, and on blocks if the slab region is
+ * exhausted.  For small requests, an empty tcache bin is refilled with a few
+ * more blocks or slots under the same lock.
+ *
+ * \param size   The slot size, if no more than `MAX_SLAB_SIZE`; otherwise the
+ *               block size, header included.
+ * \param class  The tcache bin to refill, or -1 for none.
+ * \param zeroed As for `heap_malloc()`.
+ * \return       A pointer to the allocated block, if successful; `NULL` if
+ *               unsuccessful.
+ */
+static void* arena_malloc (size_t size, int class, bool* zeroed) {
+
+  arena_s* arena = choose_arena();
+  for (unsigned int tried = 0; tried < num_arenas; tried++) {
+
+    pthread_mutex_lock(&arena->lock);
+    remote_free_drain(arena);
+    void* new_block_ptr = arena_alloc(arena, size, zeroed);
+    if (new_block_ptr == NULL && size <= MAX_SLAB_SIZE) {
+      // The slab region is used up, so serve this one (uncached) by a block.
+      new_block_ptr = heap_malloc(arena, REQUEST_TO_BLOCK_SIZE(size), zeroed);
+      class         = -1;
+    }
+    if (class >= 0 && new_block_ptr != NULL) {
+      // Stock the empty bin so that the next few requests avoid the lock.
+      for (int i = 0; i < TCACHE_REFILL_COUNT; i++) {
+        void* extra_ptr = arena_alloc(arena, size, NULL);
+        if (extra_ptr == NULL) {
+          break;
+        }
+        if (size > MAX_SLAB_SIZE) {
+          SET_FLAG(BLOCK_TO_HEADER(extra_ptr), CACHED_FLAG);
+        }
+        tcache_push(class, extra_ptr);
+      }
+    }
+    pthread_mutex_unlock(&arena->lock);
+
+    if (new_block_ptr != NULL) {
+      return new_block_ptr;
+    }
+    arena = &arenas[(arena->index + 1) % num_arenas];
+
+  }
+  return NULL;
+
+} // arena_malloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Count bytes as newly mapped for blocks of their own, or as unmapped.
+ *
+ * \param bytes The number of bytes: positive if mapped, negative if unmapped.
+ */
+static void count_mmapped (long bytes) {
+
+  size_t total = __atomic_add_fetch(&mmapped_bytes, bytes, __ATOMIC_RELAXED);
+  size_t peak  = __atomic_load_n(&peak_mmapped_bytes, __ATOMIC_RELAXED);
+  while (total > peak &&
+         !__atomic_compare_exchange_n(&peak_mmapped_bytes, &peak, total, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    // `peak` now holds the latest value; try again
+  }
+
+} // count_mmapped ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a large block in a mapping of its own, so that freeing it returns
+ * its memory to the OS at once.  For an alignment of up to a page, the block
+ * starts that far into the mapping; for a larger one, a page in, and the
+ * mapping is over-sized and then trimmed so that the block lands aligned.
+ *
+ * \param size      The number of bytes requested.
+ * \param alignment The block's alignment: a power of two, at least `ALIGNMENT`.
+ * \return          A pointer to the block, if successful; `NULL` if unsuccessful.
+ */
+static void* mmap_malloc (size_t size, size_t alignment) {
+
+  size_t offset = (alignment <= (size_t)PAGE_SIZE) ? alignment : (size_t)PAGE_SIZE;
+  size_t slack  = alignment - offset;
+  if (size > SIZE_MAX - PAGE_SIZE - offset - slack) {
+    return NULL; // the mapping's size would overflow
+  }
+  size_t length  = PAGE_UP(size + offset);
+  void*  mapping = mmap(NULL, length + slack, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  // Trim off whatever the alignment did not need, at either end.
+  intptr_t start = (((intptr_t)mapping + offset + alignment - 1) & ~(intptr_t)(alignment - 1)) - offset;
+  if (start > (intptr_t)mapping) {
+    munmap(mapping, start - (intptr_t)mapping);
+  }
+  if (start + length < (intptr_t)mapping + length + slack) {
+    munmap((void*)(start + length), (intptr_t)mapping + slack - start);
+  }
+
+  // Place the header so that the block itself is aligned.
+  header_s* header_ptr = (header_s*)(start + offset - HEADER_SIZE);
+  header_ptr->tag      = MAKE_TAG(length, MMAP_ARENA, ALLOCATED_FLAG);
+  count_mmapped(length);
+  return HEADER_TO_BLOCK(header_ptr);
+
+} // mmap_malloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Resize an individually mapped block with `mremap()`, which may move it
+ * without copying its pages.
+ *
+ * \param header_ptr The header of the block to resize.
+ * \param size       The number of bytes requested.
+ * \return           A pointer to the (possibly moved) block, if successful;
+ *                   `NULL` if unsuccessful, in which case the block is
+ *                   unchanged.
+ */
+static void* mmap_resize (header_s* header_ptr, size_t size) {
+
+  // The block stays as far into its mapping as it was, so that it keeps its
+  // alignment (up to a page) if it moves.
+  size_t offset = (intptr_t)HEADER_TO_BLOCK(header_ptr) - MMAP_START(header_ptr);
+  if (size > SIZE_MAX - PAGE_SIZE - offset) {
+    return NULL; // the mapping's size would overflow
+  }
+  size_t length = PAGE_UP(size + offset);
+  if (length == BLOCK_SIZE(header_ptr)) {
+    return HEADER_TO_BLOCK(header_ptr);
+  }
+
+  size_t old_length = BLOCK_SIZE(header_ptr);
+  void*  mapping    = mremap((void*)MMAP_START(header_ptr), old_length, length, MREMAP_MAYMOVE);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+  count_mmapped((long)length - (long)old_length);
+  header_ptr      = (header_s*)((intptr_t)mapping + offset - HEADER_SIZE);
+  header_ptr->tag = MAKE_TAG(length, MMAP_ARENA, ALLOCATED_FLAG);
+  return HEADER_TO_BLOCK(header_ptr);
+
+} // mmap_resize ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Determine how many bytes an allocated slot or block can hold.
+ *
+ * \param ptr The slot or block.
+ * \return    Its usable size, which may exceed the size requested for it.
+ */
+static size_t usable_size (void* ptr) {
+
+  if (IS_SLAB_PTR(ptr)) {
+    return SLAB_OF(ptr)->slot_size;
+  }
+  header_s* header_ptr = BLOCK_TO_HEADER(ptr);
+  if (BLOCK_ARENA(header_ptr) == MMAP_ARENA) {
+    return BLOCK_SIZE(header_ptr) - ((intptr_t)ptr - MMAP_START(header_ptr));
+  }
+  return USABLE_SIZE(header_ptr);
+
+} // usable_size ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Decide whether the allocation that has just run this thread's countdown
+ * out is to be sampled, and start the countdown to the next.  A thread's
+ * first allocation only seeds its random state, since the countdown it ran
+ * out was never drawn.
+ *
+ * \return Whether to sample the allocation.
+ */
+static bool sample_due () {
+
+  bool seeded = (sample_seed != 0);
+  if (!seeded) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    sample_seed = ((uintptr_t)&sample_seed ^ (uint64_t)now.tv_nsec) * 0x9e3779b97f4a7c15 | 1;
+  }
+  sample_countdown = heap_profile_interval(&sample_seed);
+  return seeded;
+
+} // sample_due ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a block that can be sampled.  The block is never a slab slot,
+ * since it needs a header to carry `SAMPLED_FLAG`; requests that would get a
+ * slot get the smallest block above one instead, from the tcache like any
+ * other if it has one.
+ *
+ * \param size   The number of bytes to allocate.
+ * \param zeroed As for `allocate()`.
+ * \return       A pointer to the allocated block, if successful; `NULL` if
+ *               unsuccessful.
+ */
+static void* sample_block (size_t size, bool* zeroed) {
+
+  void* new_block_ptr;
+  if (size >= mmap_threshold) {
+    if (zeroed != NULL) {
+      *zeroed = true;
+    }
+    new_block_ptr = mmap_malloc(size, ALIGNMENT);
+  } else {
+    size_t block_size = REQUEST_TO_BLOCK_SIZE(size);
+    if (block_size <= MAX_SLAB_SIZE) {
+      block_size = MAX_SLAB_SIZE + ALIGNMENT;
+    }
+    int class = (block_size <= MAX_SMALL_SIZE && tcache_ready()) ? size_class(block_size) : -1;
+    if (class >= 0 && tcache.bins[class] != NULL) {
+      new_block_ptr = tcache_pop(class);
+      CLEAR_FLAG(BLOCK_TO_HEADER(new_block_ptr), CACHED_FLAG);
+    } else {
+      new_block_ptr = arena_malloc(block_size, class, zeroed);
+    }
+  }
+  return new_block_ptr;
+
+} // sample_block ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a block for a sampled request, and record it with the heap
+ * profiler.
+ *
+ * \param size   The number of bytes to allocate.
+ * \param zeroed As for `allocate()`.
+ * \return       A pointer to the allocated block, if successful; `NULL` if
+ *               unsuccessful.
+ */
+static void* sampled_allocate (size_t size, bool* zeroed) {
+
+  void* new_block_ptr = sample_block(size, zeroed);
+  if (new_block_ptr != NULL && heap_profile_record(new_block_ptr, size)) {
+    SET_FLAG(BLOCK_TO_HEADER(new_block_ptr), SAMPLED_FLAG);
+  }
+  return new_block_ptr;
+
+} // sampled_allocate ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Tell the heap profiler about a block resized by realloc(), which now has a
+ * header (resizing drops the block's flags).  A sampled block's sample
+ * follows it, staying with the stack that allocated it.  Otherwise, any
+ * growth is counted down like an allocation of its own, and sampled, with
+ * the stack that resized the block, if it runs the count out.
+ *
+ * \param old_ptr  The block before resizing.
+ * \param new_ptr  The block after resizing, which may be `old_ptr` itself.
+ * \param old_size The usable size of the block before resizing.
+ * \param size     The number of bytes requested now.
+ * \param sampled  Was the block sampled before resizing?
+ * \return         `new_ptr`.
+ */
+static void* resample (void* old_ptr, void* new_ptr, size_t old_size, size_t size, bool sampled) {
+
+  if (sampled) {
+    heap_profile_move(old_ptr, new_ptr, size);
+    SET_FLAG(BLOCK_TO_HEADER(new_ptr), SAMPLED_FLAG);
+  } else if (profiling && size > old_size && (sample_countdown -= size - old_size) < 0 &&
+             sample_due() && heap_profile_record(new_ptr, size)) {
+    SET_FLAG(BLOCK_TO_HEADER(new_ptr), SAMPLED_FLAG);
+  }
+  return new_ptr;
+
+} // resample ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Tell the heap profiler that a sampled block is being freed (or resized),
+ * and clear its flag.
+ *
+ * \param header_ptr The block's header, which has `SAMPLED_FLAG` set.
+ */
+static void forget_sample (header_s* header_ptr) {
+
+  heap_profile_forget(HEADER_TO_BLOCK(header_ptr));
+  CLEAR_FLAG(header_ptr, SAMPLED_FLAG);
+
+} // forget_sample ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space.  Requests of up to `MAX_SLAB_SIZE`
+ * bytes get a slab slot, and those of at least `mmap_threshold` bytes a
+ * mapping of their own; the rest get a block.  Small requests are served from
+ * this thread's tcache when it has a slot or block of the right class;
+ * otherwise the thread's arena is searched under its lock.  While profiling,
+ * each thread counts down the bytes it allocates, and samples the request
+ * that runs the count out.
+ *
+ * \param size   The number of bytes to allocate.
+ * \param zeroed If not `NULL`, set to whether the block is known to be all
+ *               zero: a fresh mapping, or fresh memory from the bump region.
+ * \return A pointer to the allocated block, if successful; `NULL` if unsuccessful.
+ */
+static void* allocate (size_t size, bool* zeroed) {
+
+  init(); // make sure the allocator is initialized
+
+  if (size == 0) { // if size is 0 do nothing and return NULL
+    return NULL;
+  }
+  if (profiling && (sample_countdown -= size) < 0 && sample_due()) {
+    return sampled_allocate(size, zeroed);
+  }
+  if (size >= mmap_threshold) {
+    if (zeroed != NULL) {
+      *zeroed = true;
+    }
+    return mmap_malloc(size, ALIGNMENT);
+  }
+
+  // Find the size of slot or block that holds the request, so that those in
+  // an exact class are all the same size and the heap stays aligned.  Block
+  // sizes are then all above `MAX_SLAB_SIZE`, so the two never share a class.
+  size = (size <= MAX_SLAB_SIZE) ? ALIGN_UP(size) : REQUEST_TO_BLOCK_SIZE(size);
+
+  bool small = (size <= MAX_SMALL_SIZE) && tcache_ready();
+  int  class = small ? size_class(size) : -1;
+
+  // The lock-free fast path: reuse a slot or block this thread freed.
+  if (small && tcache.bins[class] != NULL) {
+    void* ptr = tcache_pop(class);
+    if (size > MAX_SLAB_SIZE) {
+      CLEAR_FLAG(BLOCK_TO_HEADER(ptr), CACHED_FLAG);
+    }
+    return ptr;
+  }
+
+  return arena_malloc(size, class, zeroed);
+
+} // allocate ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space aligned to `alignment`.  A slab slot
+ * whose size is a multiple of the alignment is aligned, since slabs are, so
+ * small requests are rounded up to such a slot.  Larger ones, and small ones
+ * given a block instead of a slot, get a block carved to the alignment from
+ * the calling thread's arena (or, failing that, another), or a mapping of
+ * their own if the request or the alignment is at least `mmap_threshold`
+ * bytes.
+ *
+ * \param alignment The alignment: a power of two.
+ * \param size      The number of bytes to allocate.
+ * \return          A pointer to the allocated block, if successful; `NULL` if
+ *                  unsuccessful or if `size` is 0.
+ */
+static void* aligned_allocate (size_t alignment, size_t size) {
+
+  if (alignment <= ALIGNMENT) {
+    return allocate(size, NULL);
+  }
+
+  init();
+  if (size == 0) {
+    return NULL;
+  }
+  if (size >= mmap_threshold || alignment >= mmap_threshold) {
+    return mmap_malloc(size, alignment);
+  }
+
+  if (size <= MAX_SLAB_SIZE && alignment <= MAX_SLAB_SIZE) {
+    size_t slot_size = (size + alignment - 1) & ~(alignment - 1);
+    void*  ptr       = allocate(slot_size, NULL);
+    if (ptr == NULL || ((intptr_t)ptr & (alignment - 1)) == 0) {
+      return ptr;
+    }
+    // Not a slot but a block, which need not be aligned: either the slab
+    // region is used up, or the profiler sampled the request.
+    free(ptr);
+  }
+
+  arena_s* arena = choose_arena();
+  for (unsigned int tried = 0; tried < num_arenas; tried++) {
+
+    pthread_mutex_lock(&arena->lock);
+    remote_free_drain(arena);
+    void* new_block_ptr = heap_memalign(arena, alignment, REQUEST_TO_BLOCK_SIZE(size));
+    pthread_mutex_unlock(&arena->lock);
+
+    if (new_block_ptr != NULL) {
+      return new_block_ptr;
+    }
+    arena = &arenas[(arena->index + 1) % num_arenas];
+
+  }
+  return NULL;
+
+} // aligned_allocate ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate and return `size` bytes of heap space.
+ *
+ * \param size The number of bytes to allocate.
+ * \return A pointer to the allocated block, if successful; `NULL` if unsuccessful.
+ */
+void* malloc (size_t size) {
+
+  return allocate(size, NULL);
+
+} // malloc()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Check that a slot or block may be freed: that it is a slot, or a block, that
+ * is allocated, reporting an error (and exiting) if not.  A slot must be
+ * neither free in its slab's map nor cached, as `slot_key` marks it.  A block
+ * must lie in a segment of the arena its header names, as the segment table
+ * records, unless its header says it has a mapping of its own.
+ *
+ * \param ptr The slot or block about to be freed.
+ */
+static void check_free (void* ptr) {
+
+  if (IS_SLAB_PTR(ptr)) {
+    slab_s*  slab   = SLAB_OF(ptr);
+    uint32_t offset = (uint32_t)((uintptr_t)ptr - SLAB_BASE(slab));
+    uint32_t slot   = SLOT_INDEX(slab, offset);
+    if (slab->slot_size == 0 || slot * slab->slot_size != offset) {
+      ERROR("Invalid free: ", (intptr_t)ptr);
+    }
+    if ((__atomic_load_n(&slab->free_map[slot / 64], __ATOMIC_RELAXED) & ((uint64_t)1 << (slot % 64))) ||
+        SLOT_KEY(ptr) == slot_key) {
+      ERROR("Double-free: ", (intptr_t)ptr); // free in its slab, or cached
+    }
+    return;
+  }
+
+  header_s*    header_ptr = BLOCK_TO_HEADER(ptr);
+  uintptr_t    span       = (uintptr_t)ptr >> SEGMENT_SHIFT;
+  unsigned int owner      = (span < NUM_SPANS) ? segment_table[span] : 0;
+  if ((owner == 0) ? BLOCK_ARENA(header_ptr) != MMAP_ARENA : owner != BLOCK_ARENA(header_ptr) + 1) {
+    ERROR("Invalid free: ", (intptr_t)ptr);
+  }
+  if (!HAS_FLAG(header_ptr, ALLOCATED_FLAG) || HAS_FLAG(header_ptr, CACHED_FLAG)) {
+    ERROR("Double-free: ", (intptr_t)header_ptr); // if header's field allocated is free then return an error stating they tried to double free a block
+  }
+
+} // check_free ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Deallocate a given block on the heap.  Slab slots are recognized by their
+ * address, and their slab's descriptor gives their class and arena.  Small
+ * slots and blocks go into this thread's tcache (returning half of a full bin
+ * first); individually mapped blocks are unmapped; others are freed into the
+ * arena that owns them, under its lock if it is this thread's arena and
+ * through its remote-free list if not.
+ *
+ * \param ptr A pointer to the block to be deallocated.
+ */
+void free (void* ptr) {
+
+  if (ptr == NULL) {
+    return; // nothing to free so return NULL
+  }
+
+  check_free(ptr);
+
+  if (IS_SLAB_PTR(ptr)) {
+    slab_s* slab = SLAB_OF(ptr);
+    if (tcache_ready()) {
+      int class = size_class(slab->slot_size);
+      if (tcache.counts[class] >= TCACHE_MAX_COUNT) {
+        tcache_drain(class, TCACHE_MAX_COUNT / 2);
+      }
+      tcache_push(class, ptr);
+      return;
+    }
+
+    arena_free_from_thread(&arenas[slab->arena], ptr);
+    return;
+  }
+
+  header_s* header_ptr = BLOCK_TO_HEADER(ptr); // retrieve header of block to be freed
+
+  if (HAS_FLAG(header_ptr, SAMPLED_FLAG)) {
+    forget_sample(header_ptr);
+  }
+
+  if (BLOCK_ARENA(header_ptr) == MMAP_ARENA) { // a large block goes straight back to the OS
+    count_mmapped(-(long)BLOCK_SIZE(header_ptr));
+    munmap((void*)MMAP_START(header_ptr), BLOCK_SIZE(header_ptr));
+    return;
+  }
+
+  // Blocks no bigger than a slot only appear once the slab region is used up,
+  // and have no tcache bin of their own.
+  size_t block_size = BLOCK_SIZE(header_ptr);
+  if (block_size > MAX_SLAB_SIZE && block_size <= MAX_SMALL_SIZE && tcache_ready()) {
+    int class = size_class(block_size);
+    if (tcache.counts[class] >= TCACHE_MAX_COUNT) {
+      tcache_drain(class, TCACHE_MAX_COUNT / 2);
+    }
+    SET_FLAG(header_ptr, CACHED_FLAG);
+    tcache_push(class, ptr);
+    return;
+  }
+
+  arena_free_from_thread(&arenas[BLOCK_ARENA(header_ptr)], ptr); // route the block back to its arena
+
+} // free()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Deallocate a block whose size is known, as C23 allows.  The block's slab or
+ * header must be read anyway, for its arena and to catch double frees, so the
+ * size is only checked against it.
+ *
+ * \param ptr  A pointer to the block to be deallocated.
+ * \param size The size requested for the block.
+ */
+void free_sized (void* ptr, size_t size) {
+
+  if (ptr != NULL && size > usable_size(ptr)) {
+    ERROR("free_sized() given a size beyond the block: ", (intptr_t)ptr, size);
+  }
+  free(ptr);
+
+} // free_sized ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Deallocate a block whose alignment and size are known, as C23 allows.  Both
+ * are only checked against the block.
+ *
+ * \param ptr       A pointer to the block to be deallocated.
+ * \param alignment The alignment requested for the block.
+ * \param size      The size requested for the block.
+ */
+void free_aligned_sized (void* ptr, size_t alignment, size_t size) {
+
+  if (ptr != NULL && alignment != 0 && (intptr_t)ptr % alignment != 0) {
+    ERROR("free_aligned_sized() given a misaligned block: ", (intptr_t)ptr, alignment);
+  }
+  free_sized(ptr, size);
+
+} // free_aligned_sized ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `n` blocks of `size` bytes each.  Blocks are taken first from this
+ * thread's tcache, then from its arena (or, failing that, the others) under a
+ * single hold of the lock, slabs handing over their free slots a bitmap word
+ * at a time.
+ *
+ * \param size The number of bytes in each block.
+ * \param n    The number of blocks to allocate.
+ * \param out  Where to store pointers to the `n` blocks.
+ * \return     The number of blocks allocated, stored in `out[0]` onwards;
+ *             less than `n` only if the heap is exhausted (or 0 if `size` is 0).
+ */
+size_t malloc_batch (size_t size, size_t n, void** out) {
+
+  init();
+
+  size_t count = 0;
+  if (size == 0) {
+    return 0;
+  }
+  if (size >= mmap_threshold) {
+    while (count < n && (out[count] = mmap_malloc(size, ALIGNMENT)) != NULL) {
+      count++;
+    }
+    return count;
+  }
+  size = (size <= MAX_SLAB_SIZE) ? ALIGN_UP(size) : REQUEST_TO_BLOCK_SIZE(size);
+
+  if (size <= MAX_SMALL_SIZE && tcache_ready()) {
+    int class = size_class(size);
+    while (count < n && tcache.bins[class] != NULL) {
+      out[count] = tcache_pop(class);
+      if (size > MAX_SLAB_SIZE) {
+        CLEAR_FLAG(BLOCK_TO_HEADER(out[count]), CACHED_FLAG);
+      }
+      count++;
+    }
+  }
+
+  arena_s* arena = choose_arena();
+  for (unsigned int tried = 0; tried < num_arenas && count < n; tried++) {
+    pthread_mutex_lock(&arena->lock);
+    remote_free_drain(arena);
+    count += arena_alloc_batch(arena, size, n - count, out + count);
+    pthread_mutex_unlock(&arena->lock);
+    arena = &arenas[(arena->index + 1) % num_arenas];
+  }
+  return count;
+
+} // malloc_batch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Deallocate `n` blocks at once, bypassing the tcache.  Those of this
+ * thread's own arena are freed under a single hold of its lock; those of each
+ * other arena are chained together and spliced onto its remote-free list with
+ * one atomic operation.  Individually mapped blocks are unmapped.
+ *
+ * \param ptrs The blocks to deallocate; any that are `NULL` are skipped.
+ * \param n    The number of blocks.
+ */
+void free_batch (void** ptrs, size_t n) {
+
+  init();
+
+  arena_s* local  = choose_arena();
+  bool     locked = false;
+  void*    firsts[MAX_ARENAS] = { NULL };
+  void*    lasts[MAX_ARENAS];
+
+  for (size_t i = 0; i < n; i++) {
+
+    void* ptr = ptrs[i];
+    if (ptr == NULL) {
+      continue;
+    }
+    check_free(ptr);
+
+    unsigned int owner;
+    if (IS_SLAB_PTR(ptr)) {
+      owner = SLAB_OF(ptr)->arena;
+    } else {
+      header_s* header_ptr = BLOCK_TO_HEADER(ptr);
+      if (HAS_FLAG(header_ptr, SAMPLED_FLAG)) {
+        forget_sample(header_ptr);
+      }
+      if (BLOCK_ARENA(header_ptr) == MMAP_ARENA) {
+        count_mmapped(-(long)BLOCK_SIZE(header_ptr));
+        munmap((void*)MMAP_START(header_ptr), BLOCK_SIZE(header_ptr));
+        continue;
+      }
+      owner = BLOCK_ARENA(header_ptr);
+    }
+
+    if (&arenas[owner] == local) {
+      if (!locked) {
+        pthread_mutex_lock(&local->lock);
+        remote_free_drain(local);
+        locked = true;
+      }
+      arena_free(local, ptr);
+    } else {
+      // Chain it for its owner, marked as cached until then.
+      if (IS_SLAB_PTR(ptr)) {
+        SLOT_KEY(ptr) = slot_key;
+      } else {
+        SET_FLAG(BLOCK_TO_HEADER(ptr), CACHED_FLAG);
+      }
+      if (firsts[owner] == NULL) {
+        lasts[owner] = ptr;
+      }
+      *(void**)ptr  = firsts[owner];
+      firsts[owner] = ptr;
+    }
+
+  }
+  if (locked) {
+    pthread_mutex_unlock(&local->lock);
+  }
+
+  for (unsigned int owner = 0; owner < num_arenas; owner++) {
+    if (firsts[owner] != NULL) {
+      remote_free_push(&arenas[owner], firsts[owner], lasts[owner]);
+    }
+  }
+
+} // free_batch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a block of `nmemb * size` bytes on the heap, zeroing its contents.
+ * Memory fresh from the OS is already zero, so only reused memory is cleared.
+ *
+ * \param nmemb The number of elements in the new block.
+ * \param size  The size, in bytes, of each of the `nmemb` elements.
+ * \return      A pointer to the newly allocated and zeroed block, if successful;
+ *              `NULL` if unsuccessful (including if `nmemb * size` overflows).
+ */
+void* calloc (size_t nmemb, size_t size) {
+
+  // Allocate a block of the requested size, unless that cannot be counted.
+  size_t block_size;
+  if (__builtin_mul_overflow(nmemb, size, &block_size)) {
+    return NULL;
+  }
+  bool  zeroed        = false;
+  void* new_block_ptr = allocate(block_size, &zeroed);
+
+  // If the allocation succeeded, clear the entire block unless it is fresh.
+  if (new_block_ptr != NULL && !zeroed) {
+    memset(new_block_ptr, 0, block_size);
+  }
+
+  return new_block_ptr;
+  
+} // calloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Update the given block at `ptr` to take on the given `size`.  Individually
+ * mapped blocks are remapped.  Heap blocks are resized in place where
+ * possible: they shrink by freeing their tails, and grow into the bump region
+ * or a free block that follows them.  A slab slot keeps its size if `size`
+ * fits.  Otherwise, a new block is allocated, and the data from the old block
+ * is copied, the old block freed, and the new block returned.
+ *
+ * \param ptr  The block to be assigned a new size.
+ * \param size The new size that the block should assume.
+ * \return     A pointer to the resultant block, which may be `ptr` itself, or
+ *             may be a newly allocated block.
+ */
+void* realloc (void* ptr, size_t size) {
+
+  // Special case: If there is no original block, then just allocate the new one
+  // of the given size.
+  if (ptr == NULL) {
+    return malloc(size);
+  }
+
+  // Special case: If the new size is 0, that's tantamount to freeing the block.
+  if (size == 0) {
+    free(ptr);
+    return NULL;
+  }
+
+  // Get the current block size from its slab or header.
+  size_t old_size = usable_size(ptr);
+  bool   sampled  = !IS_SLAB_PTR(ptr) && HAS_FLAG(BLOCK_TO_HEADER(ptr), SAMPLED_FLAG);
+
+  if (IS_SLAB_PTR(ptr)) {
+    // If the new size isn't an increase, then just return the original slot as-is.
+    if (size <= old_size) {
+      return ptr;
+    }
+  } else if (BLOCK_ARENA(BLOCK_TO_HEADER(ptr)) == MMAP_ARENA) {
+    void* new_block_ptr = mmap_resize(BLOCK_TO_HEADER(ptr), size);
+    if (new_block_ptr != NULL) {
+      return resample(ptr, new_block_ptr, old_size, size, sampled);
+    }
+  } else if (size < mmap_threshold) {
+    // Blocks that outgrow the heap move to a mapping of their own, where any
+    // further growth can be remapped.
+    header_s* header_ptr = BLOCK_TO_HEADER(ptr);
+    arena_s*  owner      = &arenas[BLOCK_ARENA(header_ptr)];
+    pthread_mutex_lock(&owner->lock);
+    bool resized = heap_resize(owner, header_ptr, REQUEST_TO_BLOCK_SIZE(size));
+    pthread_mutex_unlock(&owner->lock);
+    if (resized) {
+      return resample(ptr, ptr, old_size, size, sampled);
+    }
+  }
+
+  // The block must move.  Allocate the new block, copy the contents of the
+  // old into it, and free the old.  A sampled block's sample moves with it,
+  // to a block that can carry it; the old block stays sampled until then.
+  void* new_block_ptr = sampled ? sample_block(size, NULL) : malloc(size);
+  if (new_block_ptr != NULL) {
+    memcpy(new_block_ptr, ptr, (size < old_size) ? size : old_size);
+    if (sampled) {
+      CLEAR_FLAG(BLOCK_TO_HEADER(ptr), SAMPLED_FLAG);
+      resample(ptr, new_block_ptr, old_size, size, true);
+    }
+    free(ptr);
+  }
+    
+  return new_block_ptr;
+  
+} // realloc()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space aligned to `alignment`, storing a
+ * pointer to them in `*memptr`.
+ *
+ * \param memptr    Where to store the pointer to the allocated block (`NULL`
+ *                  if `size` is 0).
+ * \param alignment The alignment: a power of two, and a multiple of
+ *                  `sizeof(void*)`.
+ * \param size      The number of bytes to allocate.
+ * \return          0 if successful; `EINVAL` if the alignment is invalid;
+ *                  `ENOMEM` if there is not enough memory.
+ */
+int posix_memalign (void** memptr, size_t alignment, size_t size) {
+
+  if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  void* new_block_ptr = aligned_allocate(alignment, size);
+  if (new_block_ptr == NULL && size != 0) {
+    return ENOMEM;
+  }
+  *memptr = new_block_ptr;
+  return 0;
+
+} // posix_memalign ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space aligned to `alignment`.
+ *
+ * \param alignment The alignment: a power of two.
+ * \param size      The number of bytes to allocate.
+ * \return          A pointer to the allocated block, if successful; `NULL` if
+ *                  unsuccessful (with `errno` set to `EINVAL` if the alignment
+ *                  is invalid).
+ */
+void* aligned_alloc (size_t alignment, size_t size) {
+
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return aligned_allocate(alignment, size);
+
+} // aligned_alloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space aligned to `alignment`.  As in glibc,
+ * an alignment that is not a power of two is rounded up to one.
+ *
+ * \param alignment The alignment.
+ * \param size      The number of bytes to allocate.
+ * \return          A pointer to the allocated block, if successful; `NULL` if
+ *                  unsuccessful.
+ */
+void* memalign (size_t alignment, size_t size) {
+
+  if ((alignment & (alignment - 1)) != 0) {
+    if (alignment > SIZE_MAX / 2 + 1) {
+      errno = EINVAL;
+      return NULL;
+    }
+    alignment = (size_t)1 << (64 - __builtin_clzl(alignment));
+  }
+  return aligned_allocate(alignment, size);
+
+} // memalign ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space aligned to the page size.
+ *
+ * \param size The number of bytes to allocate.
+ * \return     A pointer to the allocated block, if successful; `NULL` if
+ *             unsuccessful.
+ */
+void* valloc (size_t size) {
+
+  return aligned_allocate(PAGE_SIZE, size);
+
+} // valloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes, rounded up to a whole number of pages (at least
+ * one), of heap space aligned to the page size.
+ *
+ * \param size The number of bytes to allocate.
+ * \return     A pointer to the allocated block, if successful; `NULL` if
+ *             unsuccessful.
+ */
+void* pvalloc (size_t size) {
+
+  if (size > SIZE_MAX - PAGE_SIZE) {
+    return NULL; // the rounded size would overflow
+  }
+  return aligned_allocate(PAGE_SIZE, (size == 0) ? (size_t)PAGE_SIZE : (size_t)PAGE_UP(size));
+
+} // pvalloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Determine how many bytes an allocated block can hold, which may be more
+ * than were asked for; all of them may be used.
+ *
+ * \param ptr The block, or `NULL`.
+ * \return    The block's usable size, or 0 if `ptr` is `NULL`.
+ */
+size_t malloc_usable_size (void* ptr) {
+
+  return (ptr == NULL) ? 0 : usable_size(ptr);
+
+} // malloc_usable_size ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Determine the smallest block size in a statistics class.
+ *
+ * \param class The statistics class.
+ * \return      The size of its smallest possible block, header included.
+ */
+static size_t class_min_size (int class) {
+
+  if (class < NUM_SMALL_CLASSES) {
+    return (size_t)(class + 1) * ALIGNMENT;
+  }
+  if (class >= NUM_SIZE_CLASSES) {
+    return TREE_MIN_SIZE;
+  }
+
+  // The inverse of `size_class()`: find the bottom of the class's share of
+  // its power-of-two range.
+  int    range = class - NUM_SMALL_CLASSES;
+  int    log2  = SMALL_SIZE_SHIFT + (range >> RANGE_SPLIT_BITS);
+  size_t split = range & ((1 << RANGE_SPLIT_BITS) - 1);
+  return ((size_t)1 << log2) + (split << (log2 - RANGE_SPLIT_BITS)) + ALIGNMENT;
+
+} // class_min_size ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Add up the counters of every arena.
+ *
+ * \param stats The snapshot to fill.
+ * \param lock  Take each arena's lock while reading it?  Without the locks,
+ *              the counters may be caught mid-update, but a signal handler
+ *              cannot risk waiting on a lock its own thread holds.
+ */
+static void gather_stats (alloc_stats_s* stats, bool lock) {
+
+  memset(stats, 0, sizeof(*stats));
+  stats->num_classes = NUM_STATS_CLASSES;
+  for (int class = 0; class < NUM_STATS_CLASSES; class++) {
+    stats->classes[class].min_size = class_min_size(class);
+  }
+
+  for (unsigned int i = 0; i < num_arenas; i++) {
+    arena_s* arena = &arenas[i];
+    if (lock) {
+      pthread_mutex_lock(&arena->lock);
+    }
+    for (int class = 0; class < NUM_STATS_CLASSES; class++) {
+      stats->classes[class].blocks_in_use += arena->class_stats[class].blocks_in_use;
+      stats->classes[class].bytes_in_use  += arena->class_stats[class].bytes_in_use;
+      stats->classes[class].free_blocks   += arena->class_stats[class].free_blocks;
+      stats->classes[class].bytes_free    += arena->class_stats[class].bytes_free;
+    }
+    stats->peak_bytes += arena->peak_in_use;
+    stats->searches   += arena->searches;
+    stats->probes     += arena->probes;
+    if (arena->start_addr != 0) {
+      stats->high_water += arena->high_water - arena->start_addr + arena->retired_bytes;
+    }
+    if (lock) {
+      pthread_mutex_unlock(&arena->lock);
+    }
+  }
+
+  size_t slabs = __atomic_load_n(&slabs_used, __ATOMIC_RELAXED);
+  if (slab_table != NULL) {
+    stats->high_water += ((slabs < SLAB_REGION_SIZE / SLAB_SIZE) ? slabs : SLAB_REGION_SIZE / SLAB_SIZE) * SLAB_SIZE;
+  }
+  stats->mmapped_bytes  = __atomic_load_n(&mmapped_bytes, __ATOMIC_RELAXED);
+  stats->peak_bytes    += __atomic_load_n(&peak_mmapped_bytes, __ATOMIC_RELAXED);
+  stats->fit_policy     = fit_policy_names[fit_policy];
+  stats->fit_candidates = (fit_policy == FIT_GOOD) ? good_fit_k : 0;
+  alloc_stats_total(stats);
+
+} // gather_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take a snapshot of the allocator's statistics.
+ *
+ * \param stats The structure to fill.
+ */
+void alloc_stats (alloc_stats_s* stats) {
+
+  gather_stats(stats, true);
+
+} // alloc_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print the allocator's statistics to `stderr`.
+ */
+void malloc_stats () {
+
+  alloc_stats_s stats;
+  gather_stats(&stats, true);
+  alloc_stats_print("bf-alloc statistics", &stats);
+
+} // malloc_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print the allocator's statistics on receipt of the `BF_STATS_SIGNAL`
+ * signal, without taking any locks.
+ *
+ * \param signal_number The signal received.
+ */
+static void stats_signal_handler (int signal_number) {
+
+  alloc_stats_s stats;
+  gather_stats(&stats, false);
+  alloc_stats_print("bf-alloc statistics", &stats);
+
+} // stats_signal_handler ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write a heap profile on receipt of the `BF_PROFILE_SIGNAL` signal.
+ *
+ * \param signal_number The signal received.
+ */
+static void profile_signal_handler (int signal_number) {
+
+  heap_profile_dump();
+
+} // profile_signal_handler ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print the allocator's statistics as the process exits, if `BF_STATS` asked
+ * for them, and write a heap profile, if `BF_PROFILE` did.
+ */
+__attribute__ ((destructor))
+static void stats_at_exit_dump () {
+
+  if (stats_at_exit) {
+    malloc_stats();
+  }
+  if (profiling) {
+    heap_profile_dump();
+  }
+
+} // stats_at_exit_dump ()
+// ==============================================================================
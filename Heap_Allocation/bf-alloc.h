@@ -0,0 +1,75 @@
+// ==============================================================================
+/**
+ * bf-alloc.h
+ *
+ * Extensions of the best-fit allocator beyond the standard interface: batched
+ * allocation and deallocation, for object pools that fill and empty many
+ * blocks of one size at a time, and the sized deallocation of C23, for C
+ * libraries that do not declare it yet.  A batch takes each arena's lock only
+ * once, however many blocks it holds.  Programs using these functions link
+ * against `libbf.so`.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_BF_ALLOC_H)
+#define _BF_ALLOC_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stddef.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `n` blocks of `size` bytes each.
+ *
+ * \param size The number of bytes in each block.
+ * \param n    The number of blocks to allocate.
+ * \param out  Where to store pointers to the blocks.
+ * \return     The number of blocks allocated, stored in `out[0]` onwards;
+ *             less than `n` only if the heap is exhausted (or 0 if `size` is 0).
+ */
+size_t malloc_batch (size_t size, size_t n, void** out);
+
+/**
+ * Free `n` blocks.
+ *
+ * \param ptrs The blocks to free; any that are `NULL` are skipped.
+ * \param n    The number of blocks.
+ */
+void free_batch (void** ptrs, size_t n);
+
+/**
+ * Free a block, given the size it was allocated with.
+ *
+ * \param ptr  The block to free, or `NULL`.
+ * \param size The size requested for the block.
+ */
+void free_sized (void* ptr, size_t size);
+
+/**
+ * Free a block, given the alignment and size it was allocated with.
+ *
+ * \param ptr       The block to free, or `NULL`.
+ * \param alignment The alignment requested for the block.
+ * \param size      The size requested for the block.
+ */
+void free_aligned_sized (void* ptr, size_t alignment, size_t size);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _BF_ALLOC_H
+// ==============================================================================
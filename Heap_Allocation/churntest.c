@@ -0,0 +1,90 @@
+// ==============================================================================
+/**
+ * churntest.c
+ *
+ * A long-running fragmentation test.  Keeps a bounded set of live blocks of
+ * random sizes and repeatedly replaces random members of it, touching every
+ * new block.  Since the live data never grows, an allocator that splits and
+ * coalesces well should reach a steady peak RSS after a warm-up period and
+ * stay there.  Run it with an allocator preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./churntest [rounds]
+ **/
+// ==============================================================================
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test-util.h"
+
+/** The number of blocks kept live at any time. */
+#define LIVE_BLOCKS      20000
+
+/** The number of replacements between RSS reports. */
+#define OPS_PER_ROUND    200000
+
+/** The rounds run before the peak RSS is expected to settle. */
+#define WARMUP_ROUNDS    5
+
+/** How much the peak may still grow after warm-up, in percent. */
+#define ALLOWED_GROWTH   10
+
+static void* blocks[LIVE_BLOCKS];
+
+/** Pick a block size: mostly small, some medium, a few large. */
+static size_t random_size () {
+
+  int kind = rand() % 100;
+  if (kind < 70) {
+    return 16 + rand() % 240;
+  } else if (kind < 95) {
+    return 256 + rand() % (4096 - 256);
+  }
+  return 4096 + rand() % (65536 - 4096);
+
+}
+
+int main (int argc, char **argv) {
+
+  int rounds = (argc > 1) ? atoi(argv[1]) : 40;
+  srand(171);
+
+  long warm_peak = 0;
+  for (int round = 1; round <= rounds; round++) {
+
+    for (int op = 0; op < OPS_PER_ROUND; op++) {
+      int    victim = rand() % LIVE_BLOCKS;
+      size_t size   = random_size();
+      free(blocks[victim]);
+      blocks[victim] = malloc(size);
+      if (blocks[victim] == NULL) {
+        printf("FAIL: malloc(%zu) returned NULL in round %d\n", size, round);
+        return 1;
+      }
+      memset(blocks[victim], round, size);
+    }
+
+    long peak = peak_rss_kb();
+    printf("round %3d: peak RSS %8ld KB\n", round, peak);
+    if (round == WARMUP_ROUNDS) {
+      warm_peak = peak;
+    }
+
+  }
+
+  for (int i = 0; i < LIVE_BLOCKS; i++) {
+    free(blocks[i]);
+  }
+
+  long final_peak = peak_rss_kb();
+  if (rounds > WARMUP_ROUNDS && final_peak * 100 > warm_peak * (100 + ALLOWED_GROWTH)) {
+    printf("FAIL: peak RSS grew from %ld KB after warm-up to %ld KB\n", warm_peak, final_peak);
+    return 1;
+  }
+  printf("PASS: peak RSS %ld KB after warm-up, %ld KB at the end\n", warm_peak, final_peak);
+  return 0;
+
+}
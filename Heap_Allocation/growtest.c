@@ -0,0 +1,88 @@
+// ==============================================================================
+/**
+ * growtest.c
+ *
+ * Checks that the heap grows past its first segments.  3 GB of blocks, each
+ * small enough to come from the heap rather than a mapping of its own, are
+ * allocated and kept live together; only the first and last bytes of each
+ * are written, so that little memory is touched.  Every block must be
+ * distinct and keep its bytes, including after some are shrunk in place with
+ * realloc(), and all must be freed without complaint.  Run it with an
+ * allocator preloaded, e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./growtest
+ **/
+// ==============================================================================
+
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test-util.h"
+
+/** The total size allocated: more than a single 2 GB heap could hold. */
+#define TOTAL_SIZE ((size_t)3 * 1024 * 1024 * 1024)
+
+/** The size of each block; below both allocators' mapping thresholds. */
+#define TEST_BLOCK_SIZE (96 * 1024)
+
+/** The number of blocks allocated. */
+#define NUM_BLOCKS (TOTAL_SIZE / TEST_BLOCK_SIZE)
+
+static unsigned char* blocks[NUM_BLOCKS];
+static size_t         sizes[NUM_BLOCKS];
+
+/** Check that a block still holds the bytes written to its ends. */
+static int check_block (size_t i) {
+
+  return check(blocks[i][0] == (unsigned char)i && blocks[i][sizes[i] - 1] == (unsigned char)~i,
+               "block contents overwritten");
+
+}
+
+int main () {
+
+  int pass = 1;
+
+  for (size_t i = 0; i < NUM_BLOCKS && pass; i++) {
+    blocks[i] = malloc(TEST_BLOCK_SIZE);
+    if (!check(blocks[i] != NULL, "malloc() returned NULL before the heap passed 2 GB") ||
+        !check((uintptr_t)blocks[i] % 16 == 0, "block is not 16-byte aligned")) {
+      pass = 0;
+      break;
+    }
+    sizes[i]                = TEST_BLOCK_SIZE;
+    blocks[i][0]            = (unsigned char)i;
+    blocks[i][sizes[i] - 1] = (unsigned char)~i;
+  }
+  for (size_t i = 0; i < NUM_BLOCKS && pass; i++) {
+    pass &= check_block(i);
+  }
+
+  // Shrink every tenth block, then check them all again.
+  for (size_t i = 0; i < NUM_BLOCKS && pass; i += 10) {
+    unsigned char* ptr = realloc(blocks[i], TEST_BLOCK_SIZE / 2);
+    if (!check(ptr != NULL, "realloc() returned NULL")) {
+      pass = 0;
+      break;
+    }
+    blocks[i]               = ptr;
+    sizes[i]                = TEST_BLOCK_SIZE / 2;
+    blocks[i][sizes[i] - 1] = (unsigned char)~i;
+  }
+  for (size_t i = 0; i < NUM_BLOCKS && pass; i++) {
+    pass &= check_block(i);
+  }
+
+  if (pass) {
+    for (size_t i = 0; i < NUM_BLOCKS; i++) {
+      free(blocks[i]);
+    }
+  }
+
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+
+}
@@ -0,0 +1,640 @@
+// ==============================================================================
+/**
+ * heap-profile.c
+ *
+ * The sampling heap profiler.  Each distinct stack that makes a sampled
+ * allocation gets a _bucket_ in a fixed, open-addressed table, holding its
+ * frames and its counts; each sampled block still live gets an entry in a
+ * second such table, keyed by its address, so that freeing it finds the
+ * bucket to take it off.  Stacks are captured with the unwinder in libgcc,
+ * which, unlike glibc's backtrace(), never allocates.  Nothing here allocates.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <unwind.h>
+
+#include "heap-profile.h"
+#include "safeio.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS AND FUNCTIONS
+
+/** The number of buckets: the most distinct stacks that can be told apart. */
+#define NUM_BUCKETS 4096
+
+/**
+ * The number of entries for live samples.  Samples are dropped rather than
+ * let the table fill past three quarters, where probing grows long; at the
+ * default rate, this covers some 24 GB of live allocations.
+ */
+#define NUM_LIVE     65536
+#define MAX_LIVE     (NUM_LIVE / 4 * 3)
+
+/** The size of the buffer that a profile is written through. */
+#define DUMP_BUFFER_SIZE 4096
+
+/** The longest file name prefix kept. */
+#define MAX_PREFIX_LENGTH 160
+
+/** The index in a table of `NUM_BUCKETS` or `NUM_LIVE` entries at which to look for a hash. */
+#define HASH_INDEX(hash, entries) ((hash) & ((entries) - 1))
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND STRUCTURES
+
+/** One stack, and the samples it has made. */
+typedef struct bucket {
+
+  /** The hash of the stack's frames, or 0 if the bucket is unused. */
+  uint64_t  hash;
+
+  /** The number of frames. */
+  int       depth;
+
+  /** The return addresses of the frames, innermost first. */
+  uintptr_t pcs[HEAP_PROFILE_MAX_DEPTH];
+
+  /** The samples ever made, and the bytes requested in them. */
+  size_t    alloc_count;
+  size_t    alloc_bytes;
+
+  /** The samples still live, and the bytes requested in them. */
+  size_t    live_count;
+  size_t    live_bytes;
+
+} bucket_s;
+
+/** A live sample. */
+typedef struct live_sample {
+
+  /** The block, or `NULL` if the entry is unused. */
+  void*  ptr;
+
+  /** The bytes requested. */
+  size_t size;
+
+  /** The bucket of the stack that allocated it. */
+  size_t bucket;
+
+} live_sample_s;
+
+/** A stack being captured. */
+typedef struct trace {
+
+  /** Where to store the frames' return addresses, and how many are stored. */
+  uintptr_t* pcs;
+  int        depth;
+
+  /** Are the frames still those of the allocator itself? */
+  bool       skipping;
+
+} trace_s;
+
+/** A profile being written, and the buffer it is written through. */
+typedef struct dump {
+
+  int    fd;
+  size_t length;
+  char   buffer[DUMP_BUFFER_SIZE];
+
+} dump_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/**
+ * The start and end of the text of the object this is linked into, whose
+ * frames are left off captured stacks.  Both are defined by the linker; they
+ * are hidden, so that they refer to this object, not the executable.
+ */
+extern const char __ehdr_start[] __attribute__ ((visibility ("hidden")));
+extern const char _etext[]       __attribute__ ((visibility ("hidden")));
+
+/** The mean number of bytes between samples. */
+static size_t sample_rate = HEAP_PROFILE_DEFAULT_RATE;
+
+/** The start of the profiles' file names. */
+static char file_prefix[MAX_PREFIX_LENGTH + 1];
+
+/** The number of profiles written so far, which numbers the next one. */
+static unsigned int dump_sequence = 0;
+
+/**
+ * Is a profile being written?  Only one is written at a time, through a
+ * buffer kept aside, since it is too big for a signal handler's stack.
+ */
+static bool   dumping      = false;
+static dump_s current_dump;
+
+/** The buckets, and the live samples, with the number of each in use. */
+static bucket_s      buckets[NUM_BUCKETS];
+static live_sample_s live[NUM_LIVE];
+static size_t        buckets_used = 0;
+static size_t        live_used    = 0;
+
+/** The samples that were dropped because a table was full. */
+static size_t dropped = 0;
+
+/** The lock over both tables, held to record or forget a sample. */
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Start profiling.
+ *
+ * \param rate   The mean number of bytes allocated between samples.
+ * \param prefix The start of the profiles' file names.
+ */
+void heap_profile_init (size_t rate, const char* prefix) {
+
+  sample_rate = (rate == 0) ? 1 : rate;
+  strncpy(file_prefix, prefix, MAX_PREFIX_LENGTH);
+
+} // heap_profile_init ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Draw the number of bytes until the next sample, exponentially distributed
+ * with a mean of the rate.  A xorshift generator supplies the uniform draw.
+ *
+ * \param seed The calling thread's random state, which is never 0.
+ * \return     The number of bytes until the next sample.
+ */
+size_t heap_profile_interval (uint64_t* seed) {
+
+  uint64_t x = *seed;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *seed = x;
+
+  // The top 53 bits make a uniform draw in (0, 1].
+  double uniform = ((x >> 11) + 1) * (1.0 / 9007199254740992.0);
+  return (size_t)(-log(uniform) * sample_rate) + 1;
+
+} // heap_profile_interval ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Hash a stack's frames, or a block's address.  The result is never 0, which
+ * marks an unused bucket.
+ *
+ * \param words The words to hash.
+ * \param count The number of words.
+ * \return      The hash.
+ */
+static uint64_t hash_words (const uintptr_t* words, int count) {
+
+  uint64_t hash = 0xcbf29ce484222325;
+  for (int i = 0; i < count; i++) {
+    hash = (hash ^ words[i]) * 0x100000001b3;
+    hash ^= hash >> 29;
+  }
+  return (hash == 0) ? 1 : hash;
+
+} // hash_words ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Store one frame of a stack being captured, unless it is one of the
+ * allocator's own, which come first.
+ *
+ * \param context The unwinder's view of the frame.
+ * \param arg     The `trace_s` being captured.
+ * \return        Whether to carry on to the next frame.
+ */
+static _Unwind_Reason_Code capture_frame (struct _Unwind_Context* context, void* arg) {
+
+  trace_s*  trace = arg;
+  uintptr_t pc    = _Unwind_GetIP(context);
+  if (pc == 0) {
+    return _URC_END_OF_STACK;
+  }
+  if (trace->skipping && pc >= (uintptr_t)__ehdr_start && pc < (uintptr_t)_etext) {
+    return _URC_NO_REASON;
+  }
+  trace->skipping            = false;
+  trace->pcs[trace->depth++] = pc;
+  return (trace->depth == HEAP_PROFILE_MAX_DEPTH) ? _URC_END_OF_STACK : _URC_NO_REASON;
+
+} // capture_frame ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find a stack's bucket, taking an unused one if it has none.  The lock must
+ * be held.  A new bucket's hash is stored last, so that a profile written
+ * without the lock sees it only once its frames are in place.
+ *
+ * \param pcs   The stack's frames.
+ * \param depth The number of frames.
+ * \return      The bucket's index, or -1 if the table is full.
+ */
+static long find_bucket (const uintptr_t* pcs, int depth) {
+
+  uint64_t hash  = hash_words(pcs, depth);
+  size_t   index = HASH_INDEX(hash, NUM_BUCKETS);
+  while (buckets[index].hash != 0) {
+    if (buckets[index].hash == hash && buckets[index].depth == depth &&
+        memcmp(buckets[index].pcs, pcs, depth * sizeof(uintptr_t)) == 0) {
+      return index;
+    }
+    index = HASH_INDEX(index + 1, NUM_BUCKETS);
+  }
+
+  if (buckets_used == NUM_BUCKETS - 1) { // leave one unused, so that probing ends
+    return -1;
+  }
+  buckets_used++;
+  buckets[index].depth = depth;
+  memcpy(buckets[index].pcs, pcs, depth * sizeof(uintptr_t));
+  __atomic_store_n(&buckets[index].hash, hash, __ATOMIC_RELEASE);
+  return index;
+
+} // find_bucket ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Enter a live sample in its table.  The lock must be held, and the table
+ * must have room.
+ *
+ * \param ptr    The block.
+ * \param size   The bytes requested.
+ * \param bucket The bucket of the stack that allocated it.
+ */
+static void live_insert (void* ptr, size_t size, size_t bucket) {
+
+  size_t index = HASH_INDEX(hash_words((uintptr_t*)&ptr, 1), NUM_LIVE);
+  while (live[index].ptr != NULL) {
+    index = HASH_INDEX(index + 1, NUM_LIVE);
+  }
+  live[index].ptr    = ptr;
+  live[index].size   = size;
+  live[index].bucket = bucket;
+  live_used++;
+
+} // live_insert ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take a live sample out of its table.  The entry is removed by shifting
+ * back any later entries that probed past it, so that no tombstones are left
+ * to lengthen probes.  The lock must be held; a block that is not in the
+ * table is reported as an error.
+ *
+ * \param ptr The block.
+ * \return    The sample's entry, as it was.
+ */
+static live_sample_s live_remove (void* ptr) {
+
+  size_t index = HASH_INDEX(hash_words((uintptr_t*)&ptr, 1), NUM_LIVE);
+  while (live[index].ptr != ptr) {
+    if (live[index].ptr == NULL) {
+      pthread_mutex_unlock(&profile_lock);
+      ERROR("Sampled block not in the heap profile: ", (intptr_t)ptr);
+    }
+    index = HASH_INDEX(index + 1, NUM_LIVE);
+  }
+  live_sample_s sample = live[index];
+  live_used--;
+
+  // Move each later entry of the run into the hole, if its home is not
+  // between the hole and it (cyclically), until the run ends.
+  size_t hole = index;
+  for (size_t next = HASH_INDEX(hole + 1, NUM_LIVE); live[next].ptr != NULL;
+       next = HASH_INDEX(next + 1, NUM_LIVE)) {
+    size_t home = HASH_INDEX(hash_words((uintptr_t*)&live[next].ptr, 1), NUM_LIVE);
+    if (HASH_INDEX(next - home, NUM_LIVE) >= HASH_INDEX(next - hole, NUM_LIVE)) {
+      live[hole] = live[next];
+      hole       = next;
+    }
+  }
+  live[hole].ptr = NULL;
+  return sample;
+
+} // live_remove ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Record a sampled allocation, and the stack that made it, as live.
+ *
+ * \param ptr  The block allocated.
+ * \param size The number of bytes requested.
+ * \return     Whether the sample was recorded.
+ */
+bool heap_profile_record (void* ptr, size_t size) {
+
+  // Capture the stack before taking the lock, so as to hold it briefly.
+  uintptr_t pcs[HEAP_PROFILE_MAX_DEPTH];
+  trace_s   trace = { .pcs = pcs, .depth = 0, .skipping = true };
+  _Unwind_Backtrace(capture_frame, &trace);
+
+  pthread_mutex_lock(&profile_lock);
+
+  long bucket = (live_used < MAX_LIVE) ? find_bucket(pcs, trace.depth) : -1;
+  if (bucket < 0) {
+    dropped++;
+    pthread_mutex_unlock(&profile_lock);
+    return false;
+  }
+
+  live_insert(ptr, size, bucket);
+  buckets[bucket].alloc_count++;
+  buckets[bucket].alloc_bytes += size;
+  buckets[bucket].live_count++;
+  buckets[bucket].live_bytes  += size;
+
+  pthread_mutex_unlock(&profile_lock);
+  return true;
+
+} // heap_profile_record ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Record that a sampled allocation has been freed, taking its bytes off its
+ * stack's bucket.
+ *
+ * \param ptr The block.
+ */
+void heap_profile_forget (void* ptr) {
+
+  pthread_mutex_lock(&profile_lock);
+
+  live_sample_s sample = live_remove(ptr);
+  buckets[sample.bucket].live_count--;
+  buckets[sample.bucket].live_bytes -= sample.size;
+
+  pthread_mutex_unlock(&profile_lock);
+
+} // heap_profile_forget ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Record that a sampled allocation has been resized, keeping it on the
+ * bucket of the stack that first allocated it with its new size.
+ *
+ * \param old_ptr The block, as passed to `heap_profile_record()`.
+ * \param new_ptr The block after resizing, which may be `old_ptr` itself.
+ * \param size    The number of bytes now requested.
+ */
+void heap_profile_move (void* old_ptr, void* new_ptr, size_t size) {
+
+  pthread_mutex_lock(&profile_lock);
+
+  live_sample_s sample = live_remove(old_ptr);
+  live_insert(new_ptr, size, sample.bucket);
+  buckets[sample.bucket].live_bytes += size - sample.size;
+
+  pthread_mutex_unlock(&profile_lock);
+
+} // heap_profile_move ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Append bytes to a profile being written, writing out the buffer whenever
+ * it fills.
+ *
+ * \param dump   The profile.
+ * \param bytes  The bytes to append.
+ * \param length The number of bytes.
+ */
+static void dump_bytes (dump_s* dump, const char* bytes, size_t length) {
+
+  while (length > 0) {
+    size_t room  = DUMP_BUFFER_SIZE - dump->length;
+    size_t chunk = (length < room) ? length : room;
+    memcpy(dump->buffer + dump->length, bytes, chunk);
+    dump->length += chunk;
+    bytes        += chunk;
+    length       -= chunk;
+    if (dump->length == DUMP_BUFFER_SIZE) {
+      safe_write(dump->fd, dump->buffer, dump->length);
+      dump->length = 0;
+    }
+  }
+
+} // dump_bytes ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Append a string, or an integer in decimal or in (`0x`-prefixed) hex, to a
+ * profile being written.
+ *
+ * \param dump   The profile.
+ * \param string The string.
+ * \param value  The integer.
+ */
+static void dump_string (dump_s* dump, const char* string) {
+
+  dump_bytes(dump, string, strlen(string));
+
+} // dump_string ()
+
+static void dump_dec (dump_s* dump, uint64_t value) {
+
+  char digits[24];
+  int_to_dec(digits, value);
+  dump_string(dump, digits);
+
+} // dump_dec ()
+
+static void dump_hex (dump_s* dump, uint64_t value) {
+
+  char digits[24];
+  int_to_hex(digits, value);
+  dump_string(dump, "0x");
+  dump_string(dump, digits);
+
+} // dump_hex ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Append one line of counts to a profile being written:
+ * `<live count>: <live bytes> [<alloc count>: <alloc bytes>] @`.
+ *
+ * \param dump        The profile.
+ * \param live_count  The samples still live.
+ * \param live_bytes  The bytes in them.
+ * \param alloc_count The samples ever made.
+ * \param alloc_bytes The bytes in them.
+ */
+static void dump_counts (dump_s* dump, size_t live_count, size_t live_bytes,
+                         size_t alloc_count, size_t alloc_bytes) {
+
+  dump_dec(dump, live_count);
+  dump_string(dump, ": ");
+  dump_dec(dump, live_bytes);
+  dump_string(dump, " [");
+  dump_dec(dump, alloc_count);
+  dump_string(dump, ": ");
+  dump_dec(dump, alloc_bytes);
+  dump_string(dump, "] @");
+
+} // dump_counts ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write a profile of the sampled allocations to the next file in sequence:
+ * a header line of totals, a line for each bucket, and then the process's
+ * mappings, copied from `/proc/self/maps`.
+ */
+void heap_profile_dump () {
+
+  char path[MAX_PREFIX_LENGTH + 64];
+  char number[24];
+  strcpy(path, file_prefix);
+  strcat(path, ".");
+  int_to_dec(number, getpid());
+  strcat(path, number);
+  strcat(path, ".");
+  int_to_dec(number, __atomic_fetch_add(&dump_sequence, 1, __ATOMIC_RELAXED));
+  strcat(path, number);
+  strcat(path, ".heap");
+
+  if (__atomic_exchange_n(&dumping, true, __ATOMIC_ACQUIRE)) {
+    PRINT("heap profile already being written; skipped");
+    return;
+  }
+  int saved_errno     = errno;
+  current_dump.fd     = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  current_dump.length = 0;
+  if (current_dump.fd < 0) {
+    PRINT("could not open heap profile; errno:", (uint64_t)errno);
+    errno = saved_errno;
+    __atomic_store_n(&dumping, false, __ATOMIC_RELEASE);
+    return;
+  }
+
+  size_t live_count  = 0;
+  size_t live_bytes  = 0;
+  size_t alloc_count = 0;
+  size_t alloc_bytes = 0;
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    if (__atomic_load_n(&buckets[i].hash, __ATOMIC_ACQUIRE) != 0) {
+      live_count  += buckets[i].live_count;
+      live_bytes  += buckets[i].live_bytes;
+      alloc_count += buckets[i].alloc_count;
+      alloc_bytes += buckets[i].alloc_bytes;
+    }
+  }
+  dump_string(&current_dump, "heap profile: ");
+  dump_counts(&current_dump, live_count, live_bytes, alloc_count, alloc_bytes);
+  dump_string(&current_dump, " heap_v2/");
+  dump_dec(&current_dump, sample_rate);
+  dump_string(&current_dump, "\n");
+
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    if (__atomic_load_n(&buckets[i].hash, __ATOMIC_ACQUIRE) != 0) {
+      dump_counts(&current_dump, buckets[i].live_count, buckets[i].live_bytes,
+                  buckets[i].alloc_count, buckets[i].alloc_bytes);
+      for (int frame = 0; frame < buckets[i].depth; frame++) {
+        dump_string(&current_dump, " ");
+        dump_hex(&current_dump, buckets[i].pcs[frame]);
+      }
+      dump_string(&current_dump, "\n");
+    }
+  }
+
+  dump_string(&current_dump, "\nMAPPED_LIBRARIES:\n");
+  int maps = open("/proc/self/maps", O_RDONLY);
+  if (maps >= 0) {
+    char    chunk[512];
+    ssize_t length;
+    while ((length = read(maps, chunk, sizeof(chunk))) > 0) {
+      dump_bytes(&current_dump, chunk, length);
+    }
+    close(maps);
+  }
+
+  safe_write(current_dump.fd, current_dump.buffer, current_dump.length);
+  close(current_dump.fd);
+  errno = saved_errno;
+  __atomic_store_n(&dumping, false, __ATOMIC_RELEASE);
+
+  char line[MAX_PREFIX_LENGTH + 96] = "heap profile written to ";
+  strcat(line, path);
+  if (dropped != 0) {
+    strcat(line, "; samples dropped for want of room:");
+    PRINT(line, (uint64_t)dropped);
+  } else {
+    PRINT(line);
+  }
+
+} // heap_profile_dump ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Handlers that keep the profiler's lock consistent across fork().
+ */
+void heap_profile_lock () {
+  pthread_mutex_lock(&profile_lock);
+}
+
+void heap_profile_unlock () {
+  pthread_mutex_unlock(&profile_lock);
+}
+// ==============================================================================
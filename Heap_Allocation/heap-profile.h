@@ -0,0 +1,122 @@
+// ==============================================================================
+/**
+ * heap-profile.h
+ *
+ * A sampling heap profiler for the allocators.  The allocator decides which
+ * allocations to sample, about one per `rate` bytes allocated, and hands each
+ * one here to have the stack that made it recorded.  Stacks and samples are
+ * kept in fixed tables set aside in advance, so that recording never
+ * allocates, and a profile of the bytes still live from each stack can be
+ * written out at any time, even from a signal handler.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_HEAP_PROFILE_H)
+#define _HEAP_PROFILE_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** The default mean number of bytes allocated between samples. */
+#define HEAP_PROFILE_DEFAULT_RATE (512 * 1024)
+
+/** The deepest stack recorded for a sample; deeper ones are cut short. */
+#define HEAP_PROFILE_MAX_DEPTH 32
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Start profiling.  Called once, by the allocator's initialization.
+ *
+ * \param rate   The mean number of bytes allocated between samples.
+ * \param prefix The start of the names of the files that profiles are
+ *               written to: `<prefix>.<pid>.<sequence>.heap`.
+ */
+void heap_profile_init (size_t rate, const char* prefix);
+
+/**
+ * Draw the number of bytes to allocate before the next sample.  Intervals
+ * are exponentially distributed about the rate, so that every byte allocated
+ * is equally likely to be sampled, whatever the pattern of sizes.
+ *
+ * \param seed The calling thread's random state; set it to anything but 0
+ *             before the first call.
+ * \return     The number of bytes until the next sample.
+ */
+size_t heap_profile_interval (uint64_t* seed);
+
+/**
+ * Record a sampled allocation, and the stack that made it, as live.  The
+ * allocator's own frames are left off the stack.
+ *
+ * \param ptr  The block allocated.
+ * \param size The number of bytes requested.
+ * \return     Whether the sample was recorded; if not (because the tables are
+ *             full), it must not be passed to `heap_profile_forget()` or
+ *             `heap_profile_move()`.
+ */
+bool heap_profile_record (void* ptr, size_t size);
+
+/**
+ * Record that a sampled allocation has been freed.
+ *
+ * \param ptr The block, as passed to `heap_profile_record()`.
+ */
+void heap_profile_forget (void* ptr);
+
+/**
+ * Record that a sampled allocation has been resized, in place or not.  Its
+ * bytes stay with the stack that allocated it.
+ *
+ * \param old_ptr The block, as passed to `heap_profile_record()`.
+ * \param new_ptr The block after resizing, which may be `old_ptr` itself.
+ * \param size    The number of bytes now requested.
+ */
+void heap_profile_move (void* old_ptr, void* new_ptr, size_t size);
+
+/**
+ * Write a profile of the sampled allocations, in the text format of
+ * gperftools' heap profiles, which `pprof` reads: for each stack, the
+ * samples still live and the bytes in them, then the samples ever made and
+ * their bytes, then the addresses of the stack's frames.  The process's
+ * mappings follow, so that the addresses can be resolved to symbols.  Counts
+ * are of samples, not of all allocations; `pprof` scales them up by the
+ * rate.  Nothing here allocates or takes a lock, so it may be called from a
+ * signal handler, though a profile written while other threads allocate may
+ * be slightly inconsistent.  The file's name is reported on `stderr`.
+ */
+void heap_profile_dump (void);
+
+/**
+ * Handlers that keep the profiler's lock consistent across fork(), for the
+ * allocator's own fork handlers to call.
+ */
+void heap_profile_lock (void);
+void heap_profile_unlock (void);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _HEAP_PROFILE_H
+// ==============================================================================
@@ -4,6 +4,19 @@
  *
  * A _pointer-bumping_ heap allocator.  This allocator *does not re-use* freed
  * blocks.  It uses _pointer bumping_ to expand the heap with each allocation.
+ * Each thread bumps through a thread-local allocation buffer (TLAB) of its
+ * own, carved from the heap with a single atomic add, so that allocating
+ * needs no locks.  Since a freed block is never used again, the whole pages
+ * inside it are returned to the OS at once.  Large blocks get a mapping of
+ * their own, which is unmapped when they are freed.  A block with a larger
+ * alignment than 16 bytes (from posix_memalign() and the like) is bumped to
+ * it, at the cost of the few bytes skipped.  The heap grows a _segment_ at a
+ * time, each twice the last: reserved without being committed, made
+ * accessible a couple of megabytes at a time as it is carved, and recorded in
+ * a segment table, one byte per 64 MB of address space, that tells heap
+ * blocks from mapped ones with a single load.  With `PB_HUGEPAGES=1`, the
+ * segments are marked for transparent huge pages, and only whole huge pages
+ * are ever returned.
  **/
 // ==============================================================================
 
@@ -12,7 +25,11 @@
 // ==============================================================================
 // INCLUDES
 
+#define _GNU_SOURCE // for mremap()
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -21,6 +38,8 @@
 #include <unistd.h>
 #include <sys/mman.h>
 
+#include "alloc-stats.h"
+#include "pb-alloc.h"
 #include "safeio.h"
 // ==============================================================================
 
@@ -40,8 +59,92 @@
 #define MB(size)  (KB(size) * 1024)
 #define GB(size)  (MB(size) * 1024)
 
-/** The virtual address space reserved for the heap. */
-#define HEAP_SIZE GB(2)
+/**
+ * The size of the heap's first segment; each new segment doubles the last, up
+ * to `MAX_SEGMENT_SIZE`.
+ */
+#define MIN_SEGMENT_SIZE MB(64)
+#define MAX_SEGMENT_SIZE GB(1)
+
+/**
+ * Segments are aligned to, and sized in multiples of, a span of 2^26 bytes
+ * (64 MB), so that the segment table can record every span of the (47-bit)
+ * user address space that belongs to the heap in a byte.
+ */
+#define SEGMENT_SHIFT 26
+#define NUM_SPANS     ((size_t)1 << (47 - SEGMENT_SHIFT))
+
+/** Is `ptr` in the heap, rather than in a block with a mapping of its own? */
+#define IN_HEAP(ptr) (((uintptr_t)(ptr) >> SEGMENT_SHIFT) < NUM_SPANS && \
+                      segment_table[(uintptr_t)(ptr) >> SEGMENT_SHIFT])
+
+/**
+ * A segment is reserved inaccessible, and made accessible (committed) this
+ * many bytes at a time as the heap is carved from it.
+ */
+#define COMMIT_SIZE MB(2)
+
+/** Requests of at least this many bytes get a mapping of their own. */
+#define MMAP_THRESHOLD KB(128)
+
+/** The default size of a thread's TLAB, and the bounds on `PB_TLAB_SIZE`. */
+#define TLAB_SIZE     KB(256)
+#define MIN_TLAB_SIZE KB(64)
+#define MAX_TLAB_SIZE MB(1)
+
+/** The alignment of every block, unless a larger one is asked for. */
+#define ALIGNMENT 16
+
+/** Round `addr` up (or down) to a multiple of the page size. */
+#define PAGE_UP(addr)   (((addr) + (PAGE_SIZE - 1)) & ~(PAGE_SIZE - 1))
+#define PAGE_DOWN(addr) ((addr) & ~(PAGE_SIZE - 1))
+
+/** The size of a transparent huge page. */
+#define HUGE_PAGE_SIZE MB(2)
+
+/**
+ * Round `addr` up (or down) to a multiple of `purge_unit`, the smallest span
+ * given back to the OS.
+ */
+#define PURGE_UP(addr)   (((addr) + (purge_unit - 1)) & ~(purge_unit - 1))
+#define PURGE_DOWN(addr) ((addr) & ~(purge_unit - 1))
+
+/**
+ * Round `addr` up to where a header can go so that the block after it is
+ * aligned to `alignment`, a power of two: just before a multiple of it.
+ */
+#define HEADER_ALIGN(addr, alignment) \
+  ((((addr) + sizeof(header_s) + (alignment) - 1) & ~(intptr_t)((alignment) - 1)) - sizeof(header_s))
+
+/**
+ * Given the header of a block with a mapping of its own, obtain the mapping's
+ * start, and its length.  The block starts `ALIGNMENT` bytes into the mapping
+ * (or as far in as a larger alignment needs), with its header in the first page.
+ */
+#define MMAP_START(hp)  PAGE_DOWN((intptr_t)(hp))
+#define MMAP_LENGTH(hp) (PAGE_UP((intptr_t)(hp) + (intptr_t)sizeof(header_s) + (intptr_t)(hp)->size) - MMAP_START(hp))
+
+/**
+ * The size classes counted in the statistics: one per power of two, up to the
+ * size of the heap.
+ */
+#define NUM_STATS_CLASSES 32
+
+/** The size of an arena's first chunk; each new chunk doubles it. */
+#define ARENA_MIN_CHUNK KB(64)
+
+/** The most that an arena's chunk size grows to, unless a request needs more. */
+#define ARENA_MAX_CHUNK MB(1)
+
+/** Round `size` up to a multiple of 16, the alignment of arena allocations. */
+#define ARENA_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+/** The bytes carved from the heap for a thread's statistics. */
+#define THREAD_STATS_SIZE ARENA_ALIGN(sizeof(thread_stats_s))
+
+/** The statistics class of a block of the given size. */
+#define STATS_CLASS(size) ((63 - __builtin_clzl(size) < NUM_STATS_CLASSES) ? \
+                           63 - __builtin_clzl(size) : NUM_STATS_CLASSES - 1)
 // ==============================================================================
 
 
@@ -55,6 +158,109 @@ typedef struct header {
   size_t size;
   
 } header_s;
+
+/**
+ * A segment of the heap, described at its own start.  Threads carve from the
+ * current segment with atomic adds, and commit it as they go; once it is
+ * full, a new segment takes its place.
+ */
+typedef struct segment {
+
+  /**
+   * The address of the next byte not yet carved off for any thread.  Only
+   * ever advanced atomically, and may pass `end_addr`, once full.
+   */
+  intptr_t        free_addr;
+
+  /** The end of the committed part of the segment; only ever raised atomically. */
+  intptr_t        commit_end;
+
+  /** The beginning and end of the segment. */
+  intptr_t        start_addr;
+  intptr_t        end_addr;
+
+  /** The segment before this one, or `NULL` if this is the first. */
+  struct segment* prev;
+
+} segment_s;
+
+/** A chunk of an arena, taken from the heap; its space follows this header. */
+typedef struct arena_chunk {
+
+  /** The next chunk in the arena, or `NULL` if this is the last. */
+  struct arena_chunk* next;
+
+  /** The bytes of space in this chunk, after this header. */
+  size_t              size;
+
+} arena_chunk_s;
+
+/**
+ * An arena.  Its chunks form a list, and allocation bumps through them in
+ * order, so a mark need only record the current chunk and bump pointer.  The
+ * chunks past the current one hold nothing live; they are reused as
+ * allocation moves on.
+ */
+struct pb_arena {
+
+  /** The first chunk, or `NULL` if the arena has none yet. */
+  arena_chunk_s* first;
+
+  /** The chunk being bumped through, or `NULL` before the first. */
+  arena_chunk_s* current;
+
+  /** The next free byte in the current chunk. */
+  intptr_t       free_addr;
+
+  /** The end of the current chunk. */
+  intptr_t       end_addr;
+
+  /** The size of the next chunk to be taken from the heap. */
+  size_t         chunk_size;
+
+};
+
+/**
+ * One thread's statistics.  Each thread counts the blocks it allocates and
+ * frees without synchronization; since a thread may free another's blocks,
+ * only the sum over all threads is meaningful.  The records are never freed,
+ * so that they can be summed after their threads have exited.
+ */
+typedef struct thread_stats {
+
+  /** The counters of blocks in use and freed in each statistics class. */
+  alloc_class_stats_s  classes[NUM_STATS_CLASSES];
+
+  /** The bytes in heap blocks allocated less those freed by this thread. */
+  long                 bytes_in_use;
+
+  /** The peak of `bytes_in_use`. */
+  size_t               peak_bytes;
+
+  /** The next thread's record. */
+  struct thread_stats* next;
+
+} thread_stats_s;
+
+/** A thread-local allocation buffer: the part of the heap a thread bumps through. */
+typedef struct tlab {
+
+  /** The address of the next available byte in the TLAB. */
+  intptr_t        free_addr;
+
+  /** The end of the TLAB. */
+  intptr_t        end_addr;
+
+  /**
+   * The highest `free_addr` in this TLAB.  `realloc()` can pull `free_addr`
+   * back, but nothing at or above this has been touched, so it is still zero.
+   */
+  intptr_t        dirty_end;
+
+  /** This thread's statistics, or `NULL` until it first counts a block. */
+  thread_stats_s* stats;
+
+} tlab_s;
 // ==============================================================================
 
 
@@ -62,14 +268,166 @@ typedef struct header {
 // ==============================================================================
 // GLOBALS
 
-/** The address of the next available byte in the heap region. */
-static intptr_t free_addr  = 0;
+/** The segment being carved from, which links to all the earlier ones. */
+static segment_s* current_segment = NULL;
+
+/** Held while replacing the current segment. */
+static pthread_mutex_t segment_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The segment table: for each `SEGMENT_SHIFT` span of the address space,
+ * whether the heap covers it.  Segments are never unmapped, so an entry, once
+ * set, never changes.
+ */
+static uint8_t segment_table[NUM_SPANS];
+
+/** Are the segments laid out for transparent huge pages? */
+static bool huge_pages = false;
+
+/** The size of each TLAB. */
+static size_t tlab_size     = TLAB_SIZE;
+
+/** The smallest span given back to the OS: a page, or a huge page. */
+static intptr_t purge_unit  = 0;
+
+/**
+ * Every thread's statistics.  A thread's blocks are counted as in use until
+ * freed, and as freed thereafter, since they are never reused.
+ */
+static thread_stats_s* all_stats = NULL;
+
+/** The statistics of threads for which no record could be carved. */
+static thread_stats_s spare_stats;
+
+/** The bytes in individually mapped blocks. */
+static size_t mmapped_bytes      = 0;
+
+/** The peak of `mmapped_bytes`. */
+static size_t peak_mmapped_bytes = 0;
+
+/** Has the heap been set up? */
+static bool initialized = false;
+
+/** Held while setting up the heap. */
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Should the statistics be printed at exit? */
+static bool stats_at_exit   = false;
+
+/**
+ * This thread's TLAB.  Initial-exec TLS is used so that reaching it never
+ * calls back into malloc() when preloaded.
+ */
+static __thread tlab_s tlab __attribute__ ((tls_model ("initial-exec")));
+// ==============================================================================
+
+
+
+static void stats_signal_handler (int signal_number);
+
+// ==============================================================================
+/**
+ * Handlers that keep the segment lock consistent across fork(): take it
+ * before forking, so that no other thread holds it mid-update, and release it
+ * in both the parent and the (single-threaded) child.
+ */
+static void lock_segments_for_fork () {
+  pthread_mutex_lock(&segment_lock);
+}
+
+static void unlock_segments_after_fork () {
+  pthread_mutex_unlock(&segment_lock);
+}
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Reserve a new segment, aligned to its span, without committing any more of
+ * it than its description needs, and record it in the segment table.
+ *
+ * \param size The size of the segment, a multiple of the span.
+ * \param prev The segment before it, or `NULL` if it is the first.
+ * \return     The segment, or `NULL` if it could not be reserved.
+ */
+static segment_s* segment_create (size_t size, segment_s* prev) {
+
+  // Reserve the segment un-shared, not backed by any file (_anonymous_
+  // space), and inaccessible, so that it costs neither swap nor commit charge
+  // until used.  Over-reserve by a span, then trim the ends to align it.
+  size_t   span   = (size_t)1 << SEGMENT_SHIFT;
+  void*    region = mmap(NULL,
+                         size + span,
+                         PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                         -1,
+                         0);
+  if (region == MAP_FAILED) {
+    return NULL;
+  }
+  intptr_t start = ((intptr_t)region + span - 1) & ~(intptr_t)(span - 1);
+  if (start > (intptr_t)region) {
+    munmap(region, start - (intptr_t)region);
+  }
+  munmap((void*)(start + size), (intptr_t)region + span - start);
+  if (huge_pages) {
+    madvise((void*)start, size, MADV_HUGEPAGE);
+  }
+  if (mprotect((void*)start, COMMIT_SIZE, PROT_READ | PROT_WRITE) != 0) {
+    munmap((void*)start, size);
+    return NULL;
+  }
+
+  segment_s* segment  = (segment_s*)start;
+  segment->free_addr  = start + ARENA_ALIGN(sizeof(segment_s));
+  segment->commit_end = start + COMMIT_SIZE;
+  segment->start_addr = start;
+  segment->end_addr   = start + size;
+  segment->prev       = prev;
+  for (uintptr_t i = start >> SEGMENT_SHIFT; i < (uintptr_t)(start + size) >> SEGMENT_SHIFT; i++) {
+    segment_table[i] = 1;
+  }
+  return segment;
+
+} // segment_create ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Commit a segment, in `COMMIT_SIZE` steps, up to `addr`.  Threads may do this
+ * at once, committing overlapping parts, which is harmless; each raises
+ * `commit_end` only after committing everything from the value it read up to
+ * the new one, so everything below `commit_end` is always committed.
+ *
+ * \param segment The segment to commit.
+ * \param addr    The address up to which the segment is needed.
+ * \return        `true` if successful; `false` if the memory could not be committed.
+ */
+static bool segment_commit (segment_s* segment, intptr_t addr) {
+
+  intptr_t committed = __atomic_load_n(&segment->commit_end, __ATOMIC_ACQUIRE);
+  if (addr <= committed) {
+    return true;
+  }
 
-/** The beginning of the heap. */
-static intptr_t start_addr = 0;
+  intptr_t commit_end = segment->start_addr +
+                        (intptr_t)(((size_t)(addr - segment->start_addr) + COMMIT_SIZE - 1) & ~(COMMIT_SIZE - 1));
+  if (commit_end > segment->end_addr) {
+    commit_end = segment->end_addr;
+  }
+  if (mprotect((void*)committed, commit_end - committed, PROT_READ | PROT_WRITE) != 0) {
+    return false;
+  }
+  while (committed < commit_end &&
+         !__atomic_compare_exchange_n(&segment->commit_end, &committed, commit_end, true,
+                                      __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+  }
+  return true;
 
-/** The end of the heap. */
-static intptr_t end_addr   = 0;
+} // segment_commit ()
 // ==============================================================================
 
 
@@ -77,37 +435,64 @@ static intptr_t end_addr   = 0;
 // ==============================================================================
 /**
  * The initialization method.  If this is the first use of the heap, initialize it.
+ * `PB_HUGEPAGES` lays the heap out for transparent huge pages, and
+ * `PB_TLAB_SIZE` overrides the size of the threads' TLABs.  `PB_STATS` asks
+ * for the statistics at exit, and `PB_STATS_SIGNAL` names a signal that
+ * prints them at any time.
  */
 
 void init () {
 
-  // Only do anything if there is no heap region (i.e., first time called).
-  if (start_addr == 0) {
+  // Only do anything the first time called.  The unlocked check keeps the
+  // common case cheap; the locked one makes sure only one thread does it.
+  if (__atomic_load_n(&initialized, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+
+  pthread_mutex_lock(&init_lock);
+  bool first_time = !initialized;
+  if (first_time) {
 
     DEBUG("Trying to initialize");
     
-    // Allocate virtual address space in which the heap will reside. Make it
-    // un-shared and not backed by any file (_anonymous_ space).  A failure to
-    // map this space is fatal.
-    void* heap = mmap(NULL,
-		      HEAP_SIZE,
-		      PROT_READ | PROT_WRITE,
-		      MAP_PRIVATE | MAP_ANONYMOUS,
-		      -1,
-		      0);
-    if (heap == MAP_FAILED) {
-      ERROR("Could not mmap() heap region");
+    const char* env = getenv("PB_HUGEPAGES");
+    huge_pages      = (env != NULL && atoi(env) != 0);
+    purge_unit      = huge_pages ? (intptr_t)HUGE_PAGE_SIZE : (intptr_t)PAGE_SIZE;
+
+    // Reserve the heap's first segment.  A failure to do so is fatal.
+    current_segment = segment_create(MIN_SEGMENT_SIZE, NULL);
+    if (current_segment == NULL) {
+      ERROR("Could not mmap() heap segment");
     }
+    all_stats       = &spare_stats;
 
-    // Hold onto the boundaries of the heap as a whole.
-    start_addr = (intptr_t)heap;
-    end_addr   = start_addr + HEAP_SIZE;
-    free_addr  = start_addr;
+    env = getenv("PB_TLAB_SIZE");
+    if (env != NULL && atol(env) > 0) {
+      tlab_size = PAGE_UP((size_t)atol(env));
+      tlab_size = (tlab_size < MIN_TLAB_SIZE) ? MIN_TLAB_SIZE :
+                  (tlab_size > MAX_TLAB_SIZE) ? MAX_TLAB_SIZE : tlab_size;
+    }
+    env             = getenv("PB_STATS");
+    stats_at_exit   = (env != NULL && atoi(env) != 0);
+    env             = getenv("PB_STATS_SIGNAL");
+    if (env != NULL && atoi(env) > 0) {
+      struct sigaction action = { .sa_handler = stats_signal_handler, .sa_flags = SA_RESTART };
+      sigemptyset(&action.sa_mask);
+      sigaction(atoi(env), &action, NULL);
+    }
+
+    __atomic_store_n(&initialized, true, __ATOMIC_RELEASE);
 
     // DEBUG: Emit a message to indicate that this allocator is being called.
     DEBUG("bp-alloc initialized");
 
   }
+  pthread_mutex_unlock(&init_lock);
+
+  // Registered outside the lock, since it may itself allocate.
+  if (first_time) {
+    pthread_atfork(lock_segments_for_fork, unlock_segments_after_fork, unlock_segments_after_fork);
+  }
 
 } // init ()
 // ==============================================================================
@@ -115,15 +500,207 @@ void init () {
 
 // ==============================================================================
 /**
- * Allocate and return `size` bytes of heap space.  Expand into the heap region
- * via _pointer bumping_.
+ * Carve `size` bytes off the heap for the calling thread, with one atomic add
+ * to the current segment, and commit them.  A carve that does not fit still
+ * uses up what was left of the segment, and moves the heap on to a new one.
  *
- * \param size The number of bytes to allocate.
+ * \param size The number of bytes, a multiple of 16, and less than `MIN_SEGMENT_SIZE`.
+ * \return The start of the bytes, if successful; 0 if no more memory can be had.
+ */
+static intptr_t heap_carve (size_t size) {
+
+  while (true) {
+    segment_s* segment = __atomic_load_n(&current_segment, __ATOMIC_ACQUIRE);
+    intptr_t   start   = __atomic_fetch_add(&segment->free_addr, size, __ATOMIC_RELAXED);
+    if (start <= segment->end_addr - (intptr_t)size) {
+      return segment_commit(segment, start + size) ? start : 0;
+    }
+
+    // Only the first thread to find the segment full replaces it; the others
+    // just carve from its replacement.
+    pthread_mutex_lock(&segment_lock);
+    if (current_segment == segment) {
+      size_t     segment_size = segment->end_addr - segment->start_addr;
+      segment_s* new_segment  = segment_create((segment_size < MAX_SEGMENT_SIZE) ? segment_size * 2 : MAX_SEGMENT_SIZE,
+                                               segment);
+      if (new_segment == NULL) {
+        pthread_mutex_unlock(&segment_lock);
+        return 0;
+      }
+      __atomic_store_n(&current_segment, new_segment, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&segment_lock);
+  }
+
+} // heap_carve ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Give the calling thread a fresh TLAB.  Whatever was left of its last one is
+ * abandoned; it was never touched, so it costs no memory.
+ *
+ * \return `true` if successful; `false` if no more memory can be had.
+ */
+static bool tlab_refill () {
+
+  intptr_t start = heap_carve(tlab_size);
+  if (start == 0) {
+    return false;
+  }
+  tlab.free_addr = start;
+  tlab.end_addr  = start + tlab_size;
+  tlab.dirty_end = start;
+  return true;
+
+} // tlab_refill ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find the calling thread's statistics, carving a record for them from the
+ * heap and adding it to `all_stats` the first time.
+ *
+ * \return The thread's statistics.
+ */
+static thread_stats_s* thread_stats () {
+
+  if (tlab.stats == NULL) {
+    thread_stats_s* stats = (thread_stats_s*)heap_carve(THREAD_STATS_SIZE);
+    if (stats == NULL) {
+      stats = &spare_stats; // already on the list; counted without synchronization
+    } else {
+      stats->next = __atomic_load_n(&all_stats, __ATOMIC_RELAXED);
+      while (!__atomic_compare_exchange_n(&all_stats, &stats->next, stats, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // `stats->next` now holds the latest head; try again
+      }
+    }
+    tlab.stats = stats;
+  }
+  return tlab.stats;
+
+} // thread_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Count bytes as newly mapped for blocks of their own, or as unmapped.
+ *
+ * \param bytes The number of bytes: positive if mapped, negative if unmapped.
+ */
+static void count_mmapped (long bytes) {
+
+  size_t total = __atomic_add_fetch(&mmapped_bytes, bytes, __ATOMIC_RELAXED);
+  size_t peak  = __atomic_load_n(&peak_mmapped_bytes, __ATOMIC_RELAXED);
+  while (total > peak &&
+         !__atomic_compare_exchange_n(&peak_mmapped_bytes, &peak, total, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    // `peak` now holds the latest value; try again
+  }
+
+} // count_mmapped ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Count a block as newly in use, no longer in use, or freed, in the calling
+ * thread's statistics.
+ *
+ * \param size   The size of the block, header included.
+ * \param in_use +1 if the block is now in use, -1 if not, 0 if neither.
+ * \param freed  +1 if the block has been freed, 0 if not.
+ */
+static void count_block (size_t size, long in_use, long freed) {
+
+  thread_stats_s*      thread = thread_stats();
+  alloc_class_stats_s* stats  = &thread->classes[STATS_CLASS(size)];
+  stats->blocks_in_use += in_use;
+  stats->bytes_in_use  += in_use * (long)size;
+  stats->free_blocks   += freed;
+  stats->bytes_free    += freed * (long)size;
+  thread->bytes_in_use += in_use * (long)size;
+  if (thread->bytes_in_use > (long)thread->peak_bytes) {
+    thread->peak_bytes = thread->bytes_in_use;
+  }
+
+} // count_block ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a large block in a mapping of its own, so that freeing it returns
+ * its memory to the OS at once.  For an alignment of up to a page, the block
+ * starts that far into the mapping; for a larger one, a page in, and the
+ * mapping is over-sized and then trimmed so that the block lands aligned.
+ *
+ * \param size      The number of bytes requested.
+ * \param alignment The block's alignment: a power of two, at least `ALIGNMENT`.
+ * \return          A pointer to the block, if successful; `NULL` if unsuccessful.
+ */
+static void* mmap_malloc (size_t size, size_t alignment) {
+
+  size_t offset = (alignment <= (size_t)PAGE_SIZE) ? alignment : (size_t)PAGE_SIZE;
+  size_t slack  = alignment - offset;
+  if (size > SIZE_MAX - PAGE_SIZE - offset - slack) {
+    return NULL; // the mapping's size would overflow
+  }
+  size_t length  = PAGE_UP(size + offset);
+  void*  mapping = mmap(NULL,
+                        length + slack,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1,
+                        0);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  // trim off whatever the alignment did not need, at either end
+  intptr_t start = (((intptr_t)mapping + offset + alignment - 1) & ~(intptr_t)(alignment - 1)) - offset;
+  if (start > (intptr_t)mapping) {
+    munmap(mapping, start - (intptr_t)mapping);
+  }
+  if (start + length < (intptr_t)mapping + length + slack) {
+    munmap((void*)(start + length), (intptr_t)mapping + slack - start);
+  }
+
+  header_s* header_ptr = (header_s*)(start + offset - sizeof(header_s));
+  header_ptr->size = size;
+  count_mmapped(length);
+  return (void*)((intptr_t)header_ptr + sizeof(header_s));
+
+} // mmap_malloc ()
+// ==============================================================================
 
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space, aligned to `alignment`.  Expand into
+ * the calling thread's TLAB via _pointer bumping_, skipping ahead to the
+ * alignment, and taking a new TLAB when it is full.  Blocks too big to leave a
+ * TLAB much use are carved from the heap directly, and large blocks,
+ * or those aligned to more than a page, get a mapping of their own.
+ *
+ * \param size      The number of bytes to allocate.
+ * \param alignment The block's alignment: a power of two, at least `ALIGNMENT`.
+ * \param zeroed    If not `NULL`, set to whether the block is known to be all
+ *                  zero: a fresh mapping, or heap never touched before.
  * \return A pointer to the allocated block, if successful; `NULL` if
  *         unsuccessful.
  */
-void* malloc (size_t size) {
+static void* allocate (size_t size, size_t alignment, bool* zeroed) {
 
   init();
 
@@ -132,32 +709,68 @@ void* malloc (size_t size) {
     return NULL;
   }
 
-  int modVal = free_addr % 16; // calc the mod of free_addr
-  if (modVal < 8) { // if current alignment is < 8, adjust it to next 8 byte
-	  free_addr += (8-modVal);
-  }
-  else if (modVal > 8) { // else if > 8, move to the next 8 bytes and put header there
-	  free_addr += (24-modVal);
+  // large blocks get their own mapping, with the header placed like any other
+  if (size >= MMAP_THRESHOLD || alignment > (size_t)PAGE_SIZE) {
+    if (zeroed != NULL) {
+      *zeroed = true;
+    }
+    return mmap_malloc(size, alignment);
   }
 
   // calculate the total size required, including the header
   size_t    total_size = size + sizeof(header_s);
-  header_s* header_ptr = (header_s*)free_addr;
-
-  // calculate the pointer to the actual block
-  void*     block_ptr  = (void*)(free_addr + sizeof(header_s));
+  header_s* header_ptr = NULL;
 
-  intptr_t new_free_addr = free_addr + total_size; // update the free address
-  if (new_free_addr > end_addr) { // check if free adress exceeds end of the heap
-    return NULL; 
+  if (total_size + alignment - ALIGNMENT > tlab_size / 4) {
+    intptr_t start = heap_carve(ARENA_ALIGN(total_size + alignment - sizeof(header_s)));
+    if (start == 0) {
+      return NULL; // no more memory to be had
+    }
+    header_ptr = (header_s*)HEADER_ALIGN(start, alignment);
+    if (zeroed != NULL) {
+      *zeroed = true;
+    }
   } else {
-    free_addr = new_free_addr;
+    intptr_t header_addr = HEADER_ALIGN(tlab.free_addr, alignment);
+    if (header_addr + (intptr_t)total_size > tlab.end_addr) {
+      if (!tlab_refill()) {
+        return NULL; // no more memory to be had
+      }
+      header_addr = HEADER_ALIGN(tlab.free_addr, alignment);
+    }
+    header_ptr     = (header_s*)header_addr;
+    tlab.free_addr = header_addr + total_size;
+    if (zeroed != NULL) {
+      *zeroed = (header_addr >= tlab.dirty_end);
+    }
+    if (tlab.free_addr > tlab.dirty_end) {
+      tlab.dirty_end = tlab.free_addr;
+    }
   }
+  void* block_ptr = (void*)((intptr_t)header_ptr + sizeof(header_s));
 
   // set the size in the header and return the ptr to allocated block
   header_ptr->size = size;
+  count_block(total_size, 1, 0);
   return block_ptr;
 
+} // allocate ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate and return `size` bytes of heap space.
+ *
+ * \param size The number of bytes to allocate.
+ * \return A pointer to the allocated block, if successful; `NULL` if
+ *         unsuccessful.
+ */
+void* malloc (size_t size) {
+
+  return allocate(size, ALIGNMENT, NULL);
+
 } // malloc()
 // ==============================================================================
 
@@ -165,8 +778,9 @@ void* malloc (size_t size) {
 
 // ==============================================================================
 /**
- * Deallocate a given block on the heap.  Add the given block (if any) to the
- * free list.
+ * Deallocate a given block on the heap.  A block with its own mapping is
+ * unmapped.  A block in the heap is never reused, so the pages that lie
+ * entirely within it are handed back to the OS.
  *
  * \param ptr A pointer to the block to be deallocated.
  */
@@ -174,28 +788,96 @@ void free (void* ptr) {
 
   DEBUG("free(): ", (intptr_t)ptr);
 
+  if (ptr == NULL) {
+    return;
+  }
+
+  header_s* header_ptr = (header_s*)((intptr_t)ptr - sizeof(header_s));
+
+  // blocks outside the heap's segments were mapped on their own
+  if (!IN_HEAP(ptr)) {
+    size_t length = MMAP_LENGTH(header_ptr);
+    count_mmapped(-(long)length);
+    munmap((void*)MMAP_START(header_ptr), length);
+    return;
+  }
+  count_block(header_ptr->size + sizeof(header_s), -1, 1);
+
+  // purge only whole pages, since the neighbouring blocks may share the others
+  intptr_t start = PURGE_UP((intptr_t)ptr);
+  intptr_t end   = PURGE_DOWN((intptr_t)ptr + (intptr_t)header_ptr->size);
+  if (start < end) {
+    madvise((void*)start, end - start, MADV_DONTNEED);
+  }
+
 } // free()
 // ==============================================================================
 
 
 
+// ==============================================================================
+/**
+ * Deallocate a block whose size is known, as C23 allows.  The size is only
+ * checked against the one recorded in the block's header.
+ *
+ * \param ptr  A pointer to the block to be deallocated.
+ * \param size The size requested for the block.
+ */
+void free_sized (void* ptr, size_t size) {
+
+  if (ptr != NULL && size > ((header_s*)((intptr_t)ptr - sizeof(header_s)))->size) {
+    ERROR("free_sized() given a size beyond the block: ", (intptr_t)ptr, size);
+  }
+  free(ptr);
+
+} // free_sized ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Deallocate a block whose alignment and size are known, as C23 allows.  Both
+ * are only checked against the block.
+ *
+ * \param ptr       A pointer to the block to be deallocated.
+ * \param alignment The alignment requested for the block.
+ * \param size      The size requested for the block.
+ */
+void free_aligned_sized (void* ptr, size_t alignment, size_t size) {
+
+  if (ptr != NULL && alignment != 0 && (intptr_t)ptr % alignment != 0) {
+    ERROR("free_aligned_sized() given a misaligned block: ", (intptr_t)ptr, alignment);
+  }
+  free_sized(ptr, size);
+
+} // free_aligned_sized ()
+// ==============================================================================
+
+
+
 // ==============================================================================
 /**
  * Allocate a block of `nmemb * size` bytes on the heap, zeroing its contents.
+ * Memory fresh from the OS is already zero, so only reused memory is cleared.
  *
  * \param nmemb The number of elements in the new block.
  * \param size  The size, in bytes, of each of the `nmemb` elements.
  * \return      A pointer to the newly allocated and zeroed block, if successful;
- *              `NULL` if unsuccessful.
+ *              `NULL` if unsuccessful (including if `nmemb * size` overflows).
  */
 void* calloc (size_t nmemb, size_t size) {
 
-  // Allocate a block of the requested size.
-  size_t block_size = nmemb * size;
-  void*  block_ptr  = malloc(block_size);
+  // Allocate a block of the requested size, unless that cannot be counted.
+  size_t block_size;
+  if (__builtin_mul_overflow(nmemb, size, &block_size)) {
+    return NULL;
+  }
+  bool  zeroed    = false;
+  void* block_ptr = allocate(block_size, ALIGNMENT, &zeroed);
 
-  // If the allocation succeeded, clear the entire block.
-  if (block_ptr != NULL) {
+  // If the allocation succeeded, clear the entire block unless it is fresh.
+  if (block_ptr != NULL && !zeroed) {
     memset(block_ptr, 0, block_size);
   }
 
@@ -208,9 +890,10 @@ void* calloc (size_t nmemb, size_t size) {
 
 // ==============================================================================
 /**
- * Update the given block at `ptr` to take on the given `size`.  Here, if `size`
- * fits within the given block, then the block is returned unchanged.  If the
- * `size` is an increase for the block, then a new and larger block is
+ * Update the given block at `ptr` to take on the given `size`.  A block with its
+ * own mapping is remapped.  The last block in the calling thread's TLAB grows
+ * or shrinks by moving the bump pointer; any other block shrinks by giving
+ * back the whole pages of its tail.  Otherwise, a new and larger block is
  * allocated, and the data from the old block is copied, the old block freed,
  * and the new block returned.
  *
@@ -234,15 +917,54 @@ void* realloc (void* ptr, size_t size) {
   header_s* old_header = (header_s*)((intptr_t)ptr - sizeof(header_s));
   size_t    old_size   = old_header->size;
 
-  // if new size is smaller, return original pointer
-  if (size <= old_size) {
+  // blocks outside the heap's segments have their own mapping, so remap it
+  if (!IN_HEAP(ptr)) {
+    // the block stays as far into its mapping as it was, keeping its alignment
+    size_t offset = (intptr_t)ptr - MMAP_START(old_header);
+    if (size <= SIZE_MAX - PAGE_SIZE - offset) {
+      size_t old_length = MMAP_LENGTH(old_header);
+      size_t length     = PAGE_UP(size + offset);
+      void*  mapping    = mremap((void*)MMAP_START(old_header), old_length, length, MREMAP_MAYMOVE);
+      if (mapping != MAP_FAILED) {
+        count_mmapped((long)length - (long)old_length);
+        header_s* header_ptr = (header_s*)((intptr_t)mapping + offset - sizeof(header_s));
+        header_ptr->size = size;
+        return (void*)((intptr_t)header_ptr + sizeof(header_s));
+      }
+    }
+  } else if ((intptr_t)ptr + (intptr_t)old_size == tlab.free_addr && size < MMAP_THRESHOLD) {
+    // the last block in this thread's TLAB grows (or shrinks) by moving the
+    // bump pointer
+    if ((intptr_t)ptr + (intptr_t)size <= tlab.end_addr) {
+      tlab.free_addr   = (intptr_t)ptr + size;
+      old_header->size = size;
+      if (tlab.free_addr > tlab.dirty_end) {
+        tlab.dirty_end = tlab.free_addr;
+      }
+      count_block(old_size + sizeof(header_s), -1, 0);
+      count_block(size + sizeof(header_s), 1, 0);
+      return ptr;
+    }
+  } else if (size <= old_size) {
+    // the tail is never reused, so give back its whole pages
+    intptr_t start = PURGE_UP((intptr_t)ptr + (intptr_t)size);
+    intptr_t end   = PURGE_DOWN((intptr_t)ptr + (intptr_t)old_size);
+    if (start < end) {
+      madvise((void*)start, end - start, MADV_DONTNEED);
+    }
+    old_header->size = size;
+    count_block(old_size + sizeof(header_s), -1, 0);
+    count_block(size + sizeof(header_s), 1, 0);
+    if (size < old_size) {
+      count_block(old_size - size, 0, 1); // the tail counts as a freed block
+    }
     return ptr;
   }
 
   void* new_ptr = malloc(size); // allocate a new block with requested size
 
   if (new_ptr != NULL) { // if the allocation is successful...
-    memcpy(new_ptr, ptr, old_size); // copy data from old block to new block
+    memcpy(new_ptr, ptr, (size < old_size) ? size : old_size); // copy data from old block to new block
     free(ptr); // free old block
   }
 
@@ -254,6 +976,420 @@ void* realloc (void* ptr, size_t size) {
 
 
 
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space aligned to `alignment`, which is never
+ * less than `ALIGNMENT`.
+ *
+ * \param alignment The alignment: a power of two.
+ * \param size      The number of bytes to allocate.
+ * \return          A pointer to the allocated block, if successful; `NULL` if
+ *                  unsuccessful or if `size` is 0.
+ */
+static void* aligned_allocate (size_t alignment, size_t size) {
+
+  return allocate(size, (alignment < ALIGNMENT) ? ALIGNMENT : alignment, NULL);
+
+} // aligned_allocate ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space aligned to `alignment`, storing a
+ * pointer to them in `*memptr`.
+ *
+ * \param memptr    Where to store the pointer to the allocated block (`NULL`
+ *                  if `size` is 0).
+ * \param alignment The alignment: a power of two, and a multiple of
+ *                  `sizeof(void*)`.
+ * \param size      The number of bytes to allocate.
+ * \return          0 if successful; `EINVAL` if the alignment is invalid;
+ *                  `ENOMEM` if there is not enough memory.
+ */
+int posix_memalign (void** memptr, size_t alignment, size_t size) {
+
+  if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  void* block_ptr = aligned_allocate(alignment, size);
+  if (block_ptr == NULL && size != 0) {
+    return ENOMEM;
+  }
+  *memptr = block_ptr;
+  return 0;
+
+} // posix_memalign ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space aligned to `alignment`.
+ *
+ * \param alignment The alignment: a power of two.
+ * \param size      The number of bytes to allocate.
+ * \return          A pointer to the allocated block, if successful; `NULL` if
+ *                  unsuccessful (with `errno` set to `EINVAL` if the alignment
+ *                  is invalid).
+ */
+void* aligned_alloc (size_t alignment, size_t size) {
+
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return aligned_allocate(alignment, size);
+
+} // aligned_alloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space aligned to `alignment`.  As in glibc,
+ * an alignment that is not a power of two is rounded up to one.
+ *
+ * \param alignment The alignment.
+ * \param size      The number of bytes to allocate.
+ * \return          A pointer to the allocated block, if successful; `NULL` if
+ *                  unsuccessful.
+ */
+void* memalign (size_t alignment, size_t size) {
+
+  if ((alignment & (alignment - 1)) != 0) {
+    if (alignment > SIZE_MAX / 2 + 1) {
+      errno = EINVAL;
+      return NULL;
+    }
+    alignment = (size_t)1 << (64 - __builtin_clzl(alignment));
+  }
+  return aligned_allocate(alignment, size);
+
+} // memalign ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes of heap space aligned to the page size.
+ *
+ * \param size The number of bytes to allocate.
+ * \return     A pointer to the allocated block, if successful; `NULL` if
+ *             unsuccessful.
+ */
+void* valloc (size_t size) {
+
+  return aligned_allocate(PAGE_SIZE, size);
+
+} // valloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes, rounded up to a whole number of pages (at least
+ * one), of heap space aligned to the page size.
+ *
+ * \param size The number of bytes to allocate.
+ * \return     A pointer to the allocated block, if successful; `NULL` if
+ *             unsuccessful.
+ */
+void* pvalloc (size_t size) {
+
+  if (size > SIZE_MAX - PAGE_SIZE) {
+    return NULL; // the rounded size would overflow
+  }
+  return aligned_allocate(PAGE_SIZE, (size == 0) ? (size_t)PAGE_SIZE : (size_t)PAGE_UP(size));
+
+} // pvalloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Determine how many bytes an allocated block can hold: here, just as many as
+ * were asked for.
+ *
+ * \param ptr The block, or `NULL`.
+ * \return    The block's usable size, or 0 if `ptr` is `NULL`.
+ */
+size_t malloc_usable_size (void* ptr) {
+
+  return (ptr == NULL) ? 0 : ((header_s*)((intptr_t)ptr - sizeof(header_s)))->size;
+
+} // malloc_usable_size ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Move an arena on to a chunk with at least `size` bytes of space: the next
+ * one, if it is big enough; otherwise a new one from the heap, linked in
+ * after the current one.
+ *
+ * \param arena The arena that has run out of space in its current chunk.
+ * \param size  The bytes needed, already aligned.
+ * \return `true` if the arena has moved on; `false` if no chunk could be had.
+ */
+static bool arena_next_chunk (pb_arena_s* arena, size_t size) {
+
+  arena_chunk_s* next = (arena->current == NULL) ? arena->first : arena->current->next;
+
+  if (next == NULL || next->size < size) {
+    size_t chunk_size = (size > arena->chunk_size) ? size : arena->chunk_size;
+    if (chunk_size > SIZE_MAX - sizeof(arena_chunk_s)) {
+      return false;
+    }
+    arena_chunk_s* chunk = allocate(chunk_size + sizeof(arena_chunk_s), ALIGNMENT, NULL);
+    if (chunk == NULL) {
+      return false;
+    }
+    chunk->size = chunk_size;
+    chunk->next = next;
+    if (arena->current == NULL) {
+      arena->first = chunk;
+    } else {
+      arena->current->next = chunk;
+    }
+    next = chunk;
+    if (arena->chunk_size < ARENA_MAX_CHUNK) {
+      arena->chunk_size *= 2;
+    }
+  }
+
+  arena->current   = next;
+  arena->free_addr = (intptr_t)next + sizeof(arena_chunk_s);
+  arena->end_addr  = arena->free_addr + next->size;
+  return true;
+
+} // arena_next_chunk ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Create an empty arena.  It takes no chunks until it is first allocated from.
+ *
+ * \return The new arena, if successful; `NULL` if unsuccessful.
+ */
+pb_arena_s* pb_arena_create () {
+
+  pb_arena_s* arena = allocate(sizeof(pb_arena_s), ALIGNMENT, NULL);
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->first      = NULL;
+  arena->chunk_size = ARENA_MIN_CHUNK;
+  pb_arena_reset(arena);
+  return arena;
+
+} // pb_arena_create ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `size` bytes from an arena by bumping its pointer, moving on to
+ * another chunk if the current one is full.
+ *
+ * \param arena The arena to allocate from.
+ * \param size  The number of bytes to allocate.
+ * \return A pointer to the allocated bytes, if successful; `NULL` if
+ *         unsuccessful or if `size` is 0.
+ */
+void* pb_arena_alloc (pb_arena_s* arena, size_t size) {
+
+  if (size == 0 || size > SIZE_MAX - 15) {
+    return NULL;
+  }
+  size = ARENA_ALIGN(size);
+
+  if (size > (size_t)(arena->end_addr - arena->free_addr) && !arena_next_chunk(arena, size)) {
+    return NULL;
+  }
+  void* block_ptr   = (void*)arena->free_addr;
+  arena->free_addr += size;
+  return block_ptr;
+
+} // pb_arena_alloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Record how far an arena's allocations have got.
+ *
+ * \param arena The arena to mark.
+ * \return The mark.
+ */
+pb_mark_s pb_arena_mark (pb_arena_s* arena) {
+
+  pb_mark_s mark = { arena->current, arena->free_addr };
+  return mark;
+
+} // pb_arena_mark ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Free everything allocated from an arena since a mark was taken, by moving
+ * the arena's bump pointer back to where it was.  The chunks after the mark's
+ * stay in the arena's list, to be bumped through again.
+ *
+ * \param arena The arena to release.
+ * \param mark  A mark taken from this arena.
+ */
+void pb_arena_release (pb_arena_s* arena, pb_mark_s mark) {
+
+  arena->current   = mark.chunk;
+  arena->free_addr = mark.free_addr;
+  arena->end_addr  = (mark.chunk == NULL) ? mark.free_addr :
+    (intptr_t)mark.chunk + sizeof(arena_chunk_s) + ((arena_chunk_s*)mark.chunk)->size;
+
+} // pb_arena_release ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Free everything allocated from an arena, keeping its chunks for reuse.
+ *
+ * \param arena The arena to reset.
+ */
+void pb_arena_reset (pb_arena_s* arena) {
+
+  pb_mark_s empty = { NULL, 0 };
+  pb_arena_release(arena, empty);
+
+} // pb_arena_reset ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Free an arena, giving its chunks back to the heap.
+ *
+ * \param arena The arena to destroy.
+ */
+void pb_arena_destroy (pb_arena_s* arena) {
+
+  arena_chunk_s* chunk = arena->first;
+  while (chunk != NULL) {
+    arena_chunk_s* next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(arena);
+
+} // pb_arena_destroy ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take a snapshot of the allocator's statistics, summing every thread's
+ * counters.  The heap is never searched, so there are no searches or probes
+ * to report.
+ *
+ * \param stats The structure to fill.
+ */
+void alloc_stats (alloc_stats_s* stats) {
+
+  memset(stats, 0, sizeof(*stats));
+  stats->num_classes = NUM_STATS_CLASSES;
+  for (int class = 0; class < NUM_STATS_CLASSES; class++) {
+    stats->classes[class].min_size = (size_t)1 << class;
+  }
+  for (thread_stats_s* thread = __atomic_load_n(&all_stats, __ATOMIC_ACQUIRE);
+       thread != NULL;
+       thread = thread->next) {
+    for (int class = 0; class < NUM_STATS_CLASSES; class++) {
+      stats->classes[class].blocks_in_use += thread->classes[class].blocks_in_use;
+      stats->classes[class].bytes_in_use  += thread->classes[class].bytes_in_use;
+      stats->classes[class].free_blocks   += thread->classes[class].free_blocks;
+      stats->classes[class].bytes_free    += thread->classes[class].bytes_free;
+    }
+    stats->peak_bytes += thread->peak_bytes;
+  }
+  for (segment_s* segment = __atomic_load_n(&current_segment, __ATOMIC_ACQUIRE);
+       segment != NULL;
+       segment = segment->prev) {
+    intptr_t carved    = __atomic_load_n(&segment->free_addr, __ATOMIC_RELAXED);
+    stats->high_water += ((carved < segment->end_addr) ? carved : segment->end_addr) - segment->start_addr;
+  }
+  stats->mmapped_bytes = __atomic_load_n(&mmapped_bytes, __ATOMIC_RELAXED);
+  stats->peak_bytes   += __atomic_load_n(&peak_mmapped_bytes, __ATOMIC_RELAXED);
+  alloc_stats_total(stats);
+
+} // alloc_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print the allocator's statistics to `stderr`.
+ */
+void malloc_stats () {
+
+  alloc_stats_s stats;
+  alloc_stats(&stats);
+  alloc_stats_print("pb-alloc statistics", &stats);
+
+} // malloc_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print the allocator's statistics on receipt of the `PB_STATS_SIGNAL`
+ * signal.
+ *
+ * \param signal_number The signal received.
+ */
+static void stats_signal_handler (int signal_number) {
+
+  malloc_stats();
+
+} // stats_signal_handler ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print the allocator's statistics as the process exits, if `PB_STATS` asked
+ * for them.
+ */
+__attribute__ ((destructor))
+static void stats_at_exit_dump () {
+
+  if (stats_at_exit) {
+    malloc_stats();
+  }
+
+} // stats_at_exit_dump ()
+// ==============================================================================
+
+
+
 #if defined (ALLOC_MAIN)
 // ==============================================================================
 /**
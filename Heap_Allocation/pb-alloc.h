@@ -0,0 +1,110 @@
+// ==============================================================================
+/**
+ * pb-alloc.h
+ *
+ * Arenas (regions) built on the pointer-bumping allocator.  An arena hands out
+ * memory by bumping a pointer through chunks that it takes from the heap, and
+ * is never freed a block at a time: instead, a mark records how far it has
+ * got, and releasing the arena to that mark (or resetting it to empty) frees
+ * everything allocated since, in constant time.  Chunks stay with the arena
+ * for reuse until it is destroyed.  A thread may use any number of arenas, but
+ * each arena must only be used by one thread at a time.  Programs using these
+ * functions link against `libpb.so`.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_PB_ALLOC_H)
+#define _PB_ALLOC_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stddef.h>
+#include <stdint.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND STRUCTURES
+
+/** An arena; its contents are private to the allocator. */
+typedef struct pb_arena pb_arena_s;
+
+/** A point in an arena's allocations, to release the arena back to. */
+typedef struct pb_mark {
+
+  /** The arena's current chunk when the mark was taken. */
+  void*    chunk;
+
+  /** The arena's bump pointer when the mark was taken. */
+  intptr_t free_addr;
+
+} pb_mark_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Create an empty arena.
+ *
+ * \return The new arena, if successful; `NULL` if unsuccessful.
+ */
+pb_arena_s* pb_arena_create (void);
+
+/**
+ * Allocate `size` bytes, 16-byte aligned, from an arena.
+ *
+ * \param arena The arena to allocate from.
+ * \param size  The number of bytes to allocate.
+ * \return A pointer to the allocated bytes, if successful; `NULL` if
+ *         unsuccessful or if `size` is 0.
+ */
+void* pb_arena_alloc (pb_arena_s* arena, size_t size);
+
+/**
+ * Record how far an arena's allocations have got.
+ *
+ * \param arena The arena to mark.
+ * \return The mark.
+ */
+pb_mark_s pb_arena_mark (pb_arena_s* arena);
+
+/**
+ * Free everything allocated from an arena since a mark was taken.  Any later
+ * marks are no longer valid.
+ *
+ * \param arena The arena to release.
+ * \param mark  A mark taken from this arena.
+ */
+void pb_arena_release (pb_arena_s* arena, pb_mark_s mark);
+
+/**
+ * Free everything allocated from an arena, keeping its chunks for reuse.
+ *
+ * \param arena The arena to reset.
+ */
+void pb_arena_reset (pb_arena_s* arena);
+
+/**
+ * Free an arena, along with its chunks and everything allocated from it.
+ *
+ * \param arena The arena to destroy.
+ */
+void pb_arena_destroy (pb_arena_s* arena);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _PB_ALLOC_H
+// ==============================================================================
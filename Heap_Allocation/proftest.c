@@ -0,0 +1,134 @@
+// ==============================================================================
+/**
+ * proftest.c
+ *
+ * Checks the heap profiler of `bf-alloc`.  128 MB of small blocks are
+ * allocated and kept live, half of them grown to size by realloc(), and as
+ * many again allocated and freed, some by realloc() and free_batch(); a
+ * profile is then written.  Its totals, scaled up by the sampling rate, must
+ * come near the bytes live and allocated, and every stack in it must start in
+ * this program, not in the allocator.  It is linked against `libbf.so`, and
+ * needs the profiler turned on:
+ *
+ *   BF_PROFILE=proftest ./proftest
+ **/
+// ==============================================================================
+
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bf-alloc.h"
+#include "heap-profile.h"
+#include "test-util.h"
+
+/** The size of each block. */
+#define TEST_BLOCK_SIZE 1024
+
+/** The bytes kept live, and the number of blocks they make. */
+#define LIVE_SIZE  ((size_t)128 * 1024 * 1024)
+#define NUM_BLOCKS (LIVE_SIZE / TEST_BLOCK_SIZE)
+
+/** How far the scaled-up totals may stray from the true ones. */
+#define TOLERANCE 0.25
+
+/** The bounds of this program's text, defined by the linker. */
+extern const char __executable_start[];
+extern const char etext[];
+
+static void* blocks[NUM_BLOCKS];
+
+/** Is `estimate` within `TOLERANCE` of `actual`? */
+static int near (double estimate, double actual) {
+
+  return estimate > actual * (1 - TOLERANCE) && estimate < actual * (1 + TOLERANCE);
+
+}
+
+int main () {
+
+  int         pass   = 1;
+  const char* prefix = getenv("BF_PROFILE");
+  const char* rate   = getenv("BF_PROFILE_RATE");
+  double      bytes  = (rate != NULL) ? atof(rate) : HEAP_PROFILE_DEFAULT_RATE;
+  if (!check(prefix != NULL, "BF_PROFILE is not set")) {
+    return 1;
+  }
+
+  // Blocks allocated and freed: singly, by realloc(), and in batches.
+  for (size_t i = 0; i < NUM_BLOCKS; i++) {
+    blocks[i] = malloc(TEST_BLOCK_SIZE);
+  }
+  for (size_t i = 0; i < NUM_BLOCKS; i += 2) {
+    free(blocks[i]);
+    blocks[i] = realloc(blocks[i + 1], TEST_BLOCK_SIZE / 2);
+    free(blocks[i]);
+  }
+
+  // The blocks kept live: half allocated whole, and half grown by realloc(),
+  // whose bytes are charged to both stacks, the one that allocated the block
+  // and the one that grew it.
+  for (size_t i = 0; i < NUM_BLOCKS; i++) {
+    if (i % 2 == 0) {
+      blocks[i] = malloc(TEST_BLOCK_SIZE);
+    } else {
+      blocks[i] = malloc(TEST_BLOCK_SIZE / 2);
+      blocks[i] = realloc(blocks[i], TEST_BLOCK_SIZE);
+    }
+    memset(blocks[i], (unsigned char)i, TEST_BLOCK_SIZE);
+  }
+  void* batch[64];
+  for (int round = 0; round < 100; round++) {
+    free_batch(batch, malloc_batch(TEST_BLOCK_SIZE, 64, batch));
+  }
+
+  heap_profile_dump();
+
+  char path[256];
+  snprintf(path, sizeof(path), "%s.%d.0.heap", prefix, (int)getpid());
+  FILE* file = fopen(path, "r");
+  if (!check(file != NULL, "no profile written")) {
+    return 1;
+  }
+
+  // The header: `heap profile: <live>: <bytes> [<allocated>: <bytes>] @ heap_v2/<rate>`.
+  size_t live_count, live_bytes, alloc_count, alloc_bytes, file_rate;
+  pass &= check(fscanf(file, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+                       &live_count, &live_bytes, &alloc_count, &alloc_bytes, &file_rate) == 5,
+                "profile has no header");
+  pass &= check(file_rate == (size_t)bytes, "profile has the wrong rate");
+  pass &= check(near(live_count * bytes, LIVE_SIZE), "live bytes are far from those allocated");
+  pass &= check(near(alloc_count * bytes, 2 * LIVE_SIZE), "allocated bytes are far from those allocated");
+
+  // Every stack with live samples starts here, and the mappings follow.  The
+  // samples of grown blocks, under either stack, are of their grown size.
+  char line[4096];
+  int  stacks = 0;
+  int  mapped = 0;
+  while (pass && fgets(line, sizeof(line), file) != NULL) {
+    if (strcmp(line, "MAPPED_LIBRARIES:\n") == 0) {
+      mapped = 1;
+      break;
+    }
+    size_t    count, size;
+    uintptr_t pc;
+    if (sscanf(line, "%zu: %zu [%*u: %*u] @ %lx", &count, &size, &pc) == 3 && count > 0) {
+      pass &= check(pc >= (uintptr_t)__executable_start && pc < (uintptr_t)etext,
+                    "stack does not start in the program");
+      pass &= check(size == count * TEST_BLOCK_SIZE, "live bytes are not whole blocks");
+      stacks++;
+    }
+  }
+  fclose(file);
+  unlink(path);
+  pass &= check(stacks == 3, "live blocks are not from the three stacks that made them");
+  pass &= check(mapped, "profile has no mappings");
+
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+
+}
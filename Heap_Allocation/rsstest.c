@@ -0,0 +1,106 @@
+// ==============================================================================
+/**
+ * rsstest.c
+ *
+ * Checks that freed memory is given back to the OS.  First a single large
+ * block is allocated, touched, and freed; then many medium blocks from the
+ * heap itself.  After each free, the resident set size should fall by most of
+ * what was allocated.  Since an allocator may hold on to freed heap memory for
+ * a while before purging it, the test waits `DECAY_WAIT_MS` and frees one more
+ * block before measuring the second time.  Run it with an allocator preloaded,
+ * e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./rsstest
+ **/
+// ==============================================================================
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** The size of the single large block. */
+#define LARGE_SIZE      (128L * 1024 * 1024)
+
+/** The size of each medium block; small enough to come from the heap. */
+#define MEDIUM_SIZE     (64L * 1024)
+
+/** The number of medium blocks. */
+#define MEDIUM_COUNT    1024
+
+/** How long to let freed heap memory sit before measuring. */
+#define DECAY_WAIT_MS   1500
+
+/** The fraction of the freed memory, in percent, that must leave the RSS. */
+#define REQUIRED_DROP   75
+
+static void* medium[MEDIUM_COUNT];
+
+/** The current resident set size, in KB. */
+static long rss_kb () {
+
+  long  pages    = 0;
+  long  resident = 0;
+  FILE* statm    = fopen("/proc/self/statm", "r");
+  if (statm != NULL) {
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(statm);
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+
+}
+
+/** Report how far the RSS fell, and whether that was far enough. */
+static int check_drop (const char* what, long before, long after, long freed_kb) {
+
+  int pass = (before - after) * 100 >= freed_kb * REQUIRED_DROP;
+  printf("%s: RSS %ld KB -> %ld KB after freeing %ld KB: %s\n",
+         what, before, after, freed_kb, pass ? "ok" : "too little returned");
+  return pass;
+
+}
+
+int main () {
+
+  int pass = 1;
+
+  // A single large block.
+  char* large = malloc(LARGE_SIZE);
+  if (large == NULL) {
+    printf("FAIL: malloc(%ld) returned NULL\n", LARGE_SIZE);
+    return 1;
+  }
+  memset(large, 1, LARGE_SIZE);
+  long before = rss_kb();
+  free(large);
+  pass &= check_drop("large block", before, rss_kb(), LARGE_SIZE / 1024);
+
+  // Many medium blocks from the heap.
+  for (int i = 0; i < MEDIUM_COUNT; i++) {
+    medium[i] = malloc(MEDIUM_SIZE);
+    if (medium[i] == NULL) {
+      printf("FAIL: malloc(%ld) returned NULL\n", MEDIUM_SIZE);
+      return 1;
+    }
+    memset(medium[i], 1, MEDIUM_SIZE);
+  }
+  before = rss_kb();
+  for (int i = 0; i < MEDIUM_COUNT; i++) {
+    free(medium[i]);
+  }
+
+  struct timespec wait = { DECAY_WAIT_MS / 1000, (DECAY_WAIT_MS % 1000) * 1000000L };
+  nanosleep(&wait, NULL);
+  free(malloc(MEDIUM_SIZE)); // give the allocator a chance to purge
+
+  pass &= check_drop("heap blocks", before, rss_kb(), MEDIUM_COUNT * MEDIUM_SIZE / 1024);
+
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+
+}
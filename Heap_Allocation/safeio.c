@@ -11,6 +11,7 @@
 // ==============================================================================
 // INCLUDES
 
+#include <errno.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -77,18 +78,45 @@ int_to_hex (char* buffer, uint64_t value) {
 
 
 
+// ==============================================================================
+void
+int_to_dec (char* buffer, uint64_t value) {
+
+  // Write the digits backwards into a scratch buffer, then copy them out.
+  char  digits[BITS_PER_WORD];
+  char* current = digits;
+  do {
+    *current++ = '0' + (value % 10);
+    value      = value / 10;
+  } while (value != 0);
+
+  while (current > digits) {
+    *buffer++ = *--current;
+  }
+  *buffer = '\0';
+
+} // int_to_dec ()
+// ==============================================================================
+
+
+
 // ==============================================================================
 /**
- * Print a message.
+ * Print a message.  `errno` is left as it was, so that printing from within
+ * an allocation call (or a signal handler) never disturbs the caller's; the
+ * `fsync()`, for one, fails with `EINVAL` when `stderr` is a pipe or terminal.
  *
  * \param prefix The string to emit as a prefix.
  * \param msg    The string to emit as a message.
  * \param argc   Count of the variadic arguments.
  * \param argp   The variadic arguments of integers to be appended to the output.
+ * \param dec    Print the integers in decimal (else hexadecimal)?
  */
 void
-emit (const char* prefix, const char* msg, int argc, va_list argp) {
+emit (const char* prefix, const char* msg, int argc, va_list argp, bool dec) {
   
+  int saved_errno = errno;
+
   // Emit the prefix and message.
   write(OUTPUT_FD, prefix, strnlen(prefix, MAX_MESSAGE_LENGTH));
   write(OUTPUT_FD, msg,    strnlen(msg,    MAX_MESSAGE_LENGTH));
@@ -97,7 +125,11 @@ emit (const char* prefix, const char* msg, int argc, va_list argp) {
   for (int i = 0; i < argc; ++i) {
     uint64_t value = va_arg(argp, uint64_t);
     char     buffer[MAX_MESSAGE_LENGTH];
-    int_to_hex(buffer, value);
+    if (dec) {
+      int_to_dec(buffer, value);
+    } else {
+      int_to_hex(buffer, value);
+    }
     write(OUTPUT_FD, TAB_STRING, TAB_LENGTH);
     write(OUTPUT_FD, buffer,     strnlen(buffer, MAX_MESSAGE_LENGTH));
   }
@@ -106,6 +138,8 @@ emit (const char* prefix, const char* msg, int argc, va_list argp) {
   write(OUTPUT_FD, NEWLINE_STRING, NEWLINE_LENGTH);
   fsync(OUTPUT_FD);
 
+  errno = saved_errno;
+
 }
 // ==============================================================================
 
@@ -127,7 +161,7 @@ safe_debug (const char* msg, int argc, ...) {
   // Emit the debugging message.
   va_list argp;
   va_start(argp, argc);
-  emit("DEBUG: ", msg, argc, argp);
+  emit("DEBUG: ", msg, argc, argp, false);
   va_end(argp);
   
 } // safe_debug ()
@@ -151,7 +185,7 @@ safe_error (const char* msg, int argc, ...) {
   // Emit the error message.
   va_list argp;
   va_start(argp, argc);
-  emit("ERROR: ", msg, argc, argp);
+  emit("ERROR: ", msg, argc, argp, false);
   va_end(argp);
 
   // And exit with an error code.
@@ -159,3 +193,60 @@ safe_error (const char* msg, int argc, ...) {
   
 } // safe_error ()
 // ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print a message with no prefix, followed by integers in decimal.
+ *
+ * \param msg  The string to emit as a message to `stderr`.  Cannot be longer
+ *             than 256 characters.
+ * \param argc Count of the variadic arguments.
+ * \param ...  The variadic arguments (0 or more) of integers to be appended to
+ *             the output.
+ */
+void
+safe_print (const char* msg, int argc, ...) {
+
+  // Emit the message.
+  va_list argp;
+  va_start(argp, argc);
+  emit("", msg, argc, argp, true);
+  va_end(argp);
+
+} // safe_print ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write the whole of a buffer to a file descriptor, retrying short writes,
+ * and leaving `errno` as it was.
+ *
+ * \param fd     The file descriptor to write to.
+ * \param buffer The bytes to write.
+ * \param length The number of bytes.
+ */
+void
+safe_write (int fd, const char* buffer, size_t length) {
+
+  int saved_errno = errno;
+
+  while (length > 0) {
+    ssize_t written = write(fd, buffer, length);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      break;
+    }
+    buffer += written;
+    length -= written;
+  }
+
+  errno = saved_errno;
+
+} // safe_write ()
+// ==============================================================================
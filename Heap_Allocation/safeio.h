@@ -17,6 +17,15 @@
 
 
 
+// ==============================================================================
+// INCLUDES
+
+#include <stddef.h>
+#include <stdint.h>
+// ==============================================================================
+
+
+
 // ==============================================================================
 // MACROS
 
@@ -25,6 +34,9 @@
 /** Emit an error message. */
 #define ERROR(msg,...) safe_error(msg, NUMARGS(__VA_ARGS__), ##__VA_ARGS__)
 
+/** Emit a message followed by decimal integers, whether or not debugging. */
+#define PRINT(msg,...) safe_print(msg, NUMARGS(__VA_ARGS__), ##__VA_ARGS__)
+
 /** Emit a debugging message (or, if disabled, remove such output). */
 #if defined (DEBUG_ALLOC)
 #define DEBUG(msg,...) safe_debug(msg, NUMARGS(__VA_ARGS__), ##__VA_ARGS__)
@@ -57,6 +69,36 @@ void safe_debug (const char* msg, int argc, ...);
  *             the output.
  */
 void safe_error (const char* msg, int argc, ...);
+
+/**
+ * Print a message with no prefix, followed by integers in decimal.
+ *
+ * \param msg  The string to emit as a message to `stderr`.  Cannot be longer
+ *             than 256 characters.
+ * \param argc Count of the variadic arguments.
+ * \param ...  The variadic arguments (0 or more) of integers to be appended to
+ *             the output.
+ */
+void safe_print (const char* msg, int argc, ...);
+
+/**
+ * Write the whole of a buffer to a file descriptor, retrying short writes,
+ * and leaving `errno` as it was.
+ *
+ * \param fd     The file descriptor to write to.
+ * \param buffer The bytes to write.
+ * \param length The number of bytes.
+ */
+void safe_write (int fd, const char* buffer, size_t length);
+
+/**
+ * Format an integer in hexadecimal (without a `0x` prefix), or in decimal.
+ *
+ * \param buffer Where to put the digits and a terminating null: at least 21 bytes.
+ * \param value  The integer to format.
+ */
+void int_to_hex (char* buffer, uint64_t value);
+void int_to_dec (char* buffer, uint64_t value);
 // ==============================================================================
 
 
@@ -0,0 +1,107 @@
+// ==============================================================================
+/**
+ * test-util.h
+ *
+ * Helpers shared by the tests and benchmarks.  Each is `static inline`, so a
+ * program needs only to include this header, and links against nothing more.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_TEST_UTIL_H)
+#define _TEST_UTIL_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Report a failed check.
+ *
+ * \param pass Whether the check passed.
+ * \param what What failed, if it did.
+ * \return     `pass`, so that results can be accumulated.
+ */
+static inline int check (int pass, const char* what) {
+
+  if (!pass) {
+    printf("FAIL: %s\n", what);
+  }
+  return pass;
+
+} // check ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Measure the peak resident set size so far.
+ *
+ * \return The peak, in KB.
+ */
+static inline long peak_rss_kb (void) {
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+
+} // peak_rss_kb ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Read the monotonic clock.
+ *
+ * \return The current time, in seconds.
+ */
+static inline double now (void) {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+
+} // now ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print a benchmark's result as CSV: a header line, then one line of results,
+ * which `make bench` collects from each benchmark.
+ *
+ * \param name    The benchmark's name.
+ * \param threads The number of threads that ran it.
+ * \param ops     The number of operations timed.
+ * \param seconds The time they took.
+ */
+static inline void bench_report (const char* name, int threads, long ops, double seconds) {
+
+  printf("benchmark,threads,ops,seconds,ops_per_sec,peak_rss_kb\n");
+  printf("%s,%d,%ld,%.3f,%.0f,%ld\n", name, threads, ops, seconds, ops / seconds, peak_rss_kb());
+
+} // bench_report ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _TEST_UTIL_H
+// ==============================================================================
@@ -0,0 +1,483 @@
+// ==============================================================================
+/**
+ * trace-record.c
+ *
+ * An allocation trace recorder.  Preloaded in front of an allocator (or
+ * glibc), it passes every malloc(), calloc(), realloc() and free() through to
+ * the next allocator and appends a record of the call to a trace file (see
+ * `trace.h`), which `trace-replay` can play back later.  The file is named by
+ * `TRACE_FILE`, defaulting to `alloc.trace`, e.g.:
+ *
+ *   TRACE_FILE=app.trace LD_PRELOAD=./libtrace.so ./app
+ *
+ * The recorder never allocates from the heap: it keeps its table of live
+ * blocks and its output buffer in memory of its own.  Calls are recorded
+ * under a single lock, so it slows multithreaded programs down.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#define _GNU_SOURCE // for RTLD_NEXT
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "trace.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS AND FUNCTIONS
+
+/** The file written if `TRACE_FILE` is not set. */
+#define DEFAULT_TRACE_FILE "alloc.trace"
+
+/** The records buffered before they are written out. */
+#define BUFFER_RECORDS 4096
+
+/** The slots in the table of live blocks; a power of two. */
+#define TABLE_SLOTS ((size_t)1 << 22)
+
+/** The most live blocks tracked, keeping the table's probes short. */
+#define MAX_LIVE_BLOCKS (TABLE_SLOTS / 4 * 3)
+
+/** The slot where the table's probe for a block's address starts. */
+#define TABLE_HOME(ptr) ((size_t)(((ptr) >> 4) * 0x9e3779b97f4a7c15ULL) & (TABLE_SLOTS - 1))
+
+/** The memory handed out while the next allocator is being looked up. */
+#define BOOTSTRAP_SIZE 4096
+
+/** Is the pointer in the bootstrap memory? */
+#define IS_BOOTSTRAP_PTR(ptr) ((char*)(ptr) >= bootstrap && (char*)(ptr) < bootstrap + BOOTSTRAP_SIZE)
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND STRUCTURES
+
+/** A live block, in the open-addressed table that maps addresses to ids. */
+typedef struct live_block {
+
+  /** The block's address (0 for an empty slot). */
+  uintptr_t ptr;
+
+  /** The block's id. */
+  uint32_t  id;
+
+} live_block_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** The next allocator's functions. */
+static void* (*next_malloc)  (size_t);
+static void* (*next_calloc)  (size_t, size_t);
+static void* (*next_realloc) (void*, size_t);
+static void  (*next_free)    (void*);
+
+/** Memory for the allocations made while looking them up. */
+static char   bootstrap[BOOTSTRAP_SIZE] __attribute__ ((aligned (16)));
+static size_t bootstrap_used = 0;
+
+/** The lock that serializes recording. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Is the recorder set up (or being set up)? */
+static bool ready        = false;
+static bool initializing = false;
+
+/** The trace file (-1 if it could not be opened). */
+static int fd = -1;
+
+/** The records not yet written out. */
+static trace_record_s buffer[BUFFER_RECORDS];
+static int            buffered = 0;
+
+/** The table of live blocks (`NULL` if it could not be mapped). */
+static live_block_s* table = NULL;
+
+/** The number of blocks in the table. */
+static size_t live_blocks = 0;
+
+/** The last id handed out. */
+static uint32_t last_id = 0;
+
+/** The last thread number handed out. */
+static uint16_t last_thread = 0;
+
+/** When the first call was recorded, in nanoseconds. */
+static uint64_t start_ns = 0;
+
+/** This thread's number (0 until its first call). */
+static __thread uint16_t thread_number __attribute__ ((tls_model ("initial-exec")));
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Handlers that keep the lock consistent across fork(): the parent goes on
+ * recording, while the child writes nothing, since its copy of the buffer
+ * holds records the parent will write.
+ */
+static void lock_for_fork () {
+  pthread_mutex_lock(&lock);
+}
+
+static void unlock_in_parent () {
+  pthread_mutex_unlock(&lock);
+}
+
+static void unlock_in_child () {
+  fd       = -1;
+  buffered = 0;
+  pthread_mutex_unlock(&lock);
+}
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find the next allocator's functions, open the trace file, and map the table
+ * of live blocks.  Any allocations made meanwhile (by dlsym(), say) come from
+ * the bootstrap memory.
+ */
+static void init () {
+
+  bool first_time = false;
+  pthread_mutex_lock(&lock);
+  if (!ready && !initializing) {
+    initializing = true;
+    next_malloc  = dlsym(RTLD_NEXT, "malloc");
+    next_calloc  = dlsym(RTLD_NEXT, "calloc");
+    next_realloc = dlsym(RTLD_NEXT, "realloc");
+    next_free    = dlsym(RTLD_NEXT, "free");
+
+    const char* name = getenv("TRACE_FILE");
+    fd = open((name != NULL) ? name : DEFAULT_TRACE_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    void* slots = mmap(NULL, TABLE_SLOTS * sizeof(live_block_s), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    table = (slots == MAP_FAILED) ? NULL : slots;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    start_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+    ready        = true;
+    initializing = false;
+    first_time   = true;
+  }
+  pthread_mutex_unlock(&lock);
+
+  // Registered outside the lock, since it may itself allocate.
+  if (first_time) {
+    pthread_atfork(lock_for_fork, unlock_in_parent, unlock_in_child);
+  }
+
+} // init ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Hand out bootstrap memory, for allocations made during init().  These are
+ * made without the lock, which init() may be holding, and other threads may
+ * make them at the same time, so the memory is claimed with an atomic add.
+ * Every claim is a multiple of 16 bytes, so each one starts aligned.
+ *
+ * \param size The number of bytes requested.
+ * \return     The memory, or `NULL` if the bootstrap memory is used up.
+ */
+static void* bootstrap_malloc (size_t size) {
+
+  if (size > BOOTSTRAP_SIZE) {
+    return NULL;
+  }
+  size_t claim = (size + 15) & ~(size_t)15; // still no more than BOOTSTRAP_SIZE
+  size_t start = __atomic_fetch_add(&bootstrap_used, claim, __ATOMIC_RELAXED);
+  if (start > BOOTSTRAP_SIZE - claim) {
+    return NULL; // used up (and it stays so, since the count only grows)
+  }
+  return bootstrap + start; // static memory is already zeroed, for calloc()
+
+} // bootstrap_malloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Write out the buffered records.  The lock must be held. */
+static void flush () {
+
+  size_t length = buffered * sizeof(trace_record_s);
+  char*  data   = (char*)buffer;
+  while (fd >= 0 && length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written <= 0) {
+      break;
+    }
+    data   += written;
+    length -= written;
+  }
+  buffered = 0;
+
+} // flush ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** The slot where a block's address is (or would go) in the table. */
+static size_t table_slot (uintptr_t ptr) {
+
+  size_t slot = TABLE_HOME(ptr);
+  while (table[slot].ptr != 0 && table[slot].ptr != ptr) {
+    slot = (slot + 1) & (TABLE_SLOTS - 1);
+  }
+  return slot;
+
+} // table_slot ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Give a new block the next id.  The lock must be held.
+ *
+ * \param ptr The block.
+ * \return    Its id, or `TRACE_NO_ID` if the table is full.
+ */
+static uint32_t add_block (void* ptr) {
+
+  if (table == NULL || ptr == NULL || live_blocks == MAX_LIVE_BLOCKS) {
+    return TRACE_NO_ID;
+  }
+  live_blocks++;
+  size_t slot     = table_slot((uintptr_t)ptr);
+  table[slot].ptr = (uintptr_t)ptr;
+  table[slot].id  = ++last_id;
+  return last_id;
+
+} // add_block ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Forget a block, shifting back the entries after it so that no probe
+ * sequence is broken.  The lock must be held.
+ *
+ * \param ptr The block.
+ * \return    Its id, or `TRACE_NO_ID` if it was not in the table.
+ */
+static uint32_t remove_block (void* ptr) {
+
+  if (table == NULL || ptr == NULL) {
+    return TRACE_NO_ID;
+  }
+  size_t slot = table_slot((uintptr_t)ptr);
+  if (table[slot].ptr == 0) {
+    return TRACE_NO_ID;
+  }
+  uint32_t id = table[slot].id;
+
+  size_t hole = slot;
+  for (size_t next = (hole + 1) & (TABLE_SLOTS - 1); table[next].ptr != 0; next = (next + 1) & (TABLE_SLOTS - 1)) {
+    size_t home = TABLE_HOME(table[next].ptr);
+    // Move the entry into the hole unless its home lies after the hole.
+    if (((next - home) & (TABLE_SLOTS - 1)) >= ((next - hole) & (TABLE_SLOTS - 1))) {
+      table[hole] = table[next];
+      hole        = next;
+    }
+  }
+  table[hole].ptr = 0;
+  live_blocks--;
+  return id;
+
+} // remove_block ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Append a record to the trace.  The lock must be held.
+ */
+static void record (uint8_t op, uint64_t size, uint32_t id, uint32_t old_id) {
+
+  if (thread_number == 0) {
+    thread_number = ++last_thread;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  trace_record_s* entry = &buffer[buffered++];
+  entry->time_ns = now.tv_sec * 1000000000ULL + now.tv_nsec - start_ns;
+  entry->size    = size;
+  entry->id      = id;
+  entry->old_id  = old_id;
+  entry->thread  = thread_number;
+  entry->op      = op;
+  if (buffered == BUFFER_RECORDS) {
+    flush();
+  }
+
+} // record ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void* malloc (size_t size) {
+
+  if (!ready) {
+    if (initializing) {
+      return bootstrap_malloc(size);
+    }
+    init();
+  }
+
+  pthread_mutex_lock(&lock);
+  void* ptr = next_malloc(size);
+  record(TRACE_MALLOC, size, add_block(ptr), TRACE_NO_ID);
+  pthread_mutex_unlock(&lock);
+  return ptr;
+
+} // malloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void* calloc (size_t nmemb, size_t size) {
+
+  if (!ready) {
+    if (initializing) {
+      return (nmemb == 0 || size <= BOOTSTRAP_SIZE / nmemb) ? bootstrap_malloc(nmemb * size) : NULL;
+    }
+    init();
+  }
+
+  pthread_mutex_lock(&lock);
+  void* ptr = next_calloc(nmemb, size);
+  record(TRACE_CALLOC, (uint64_t)nmemb * size, add_block(ptr), TRACE_NO_ID);
+  pthread_mutex_unlock(&lock);
+  return ptr;
+
+} // calloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void* realloc (void* ptr, size_t size) {
+
+  // During init(), which holds the lock, calls are neither recorded nor
+  // locked: new blocks come from the bootstrap memory, and any others are
+  // passed straight to the next allocator (once it is known).
+  if (!ready && initializing && !IS_BOOTSTRAP_PTR(ptr)) {
+    if (ptr == NULL) {
+      return bootstrap_malloc(size);
+    }
+    return (next_realloc != NULL) ? next_realloc(ptr, size) : NULL;
+  }
+  if (!ready) {
+    init();
+  }
+  if (IS_BOOTSTRAP_PTR(ptr)) {
+    // Move it out of the bootstrap memory; its size is unknown, but no more
+    // than what is left of that memory.
+    void* new_ptr = malloc(size);
+    if (new_ptr != NULL) {
+      size_t available = bootstrap + BOOTSTRAP_SIZE - (char*)ptr;
+      memcpy(new_ptr, ptr, (size < available) ? size : available);
+    }
+    return new_ptr;
+  }
+
+  // The old block is forgotten before the call, since once it is freed
+  // another thread may be handed the same address.
+  pthread_mutex_lock(&lock);
+  uint32_t old_id  = remove_block(ptr);
+  void*    new_ptr = next_realloc(ptr, size);
+  uint32_t new_id;
+  if (new_ptr == NULL && ptr != NULL && size != 0) {
+    new_id = TRACE_NO_ID; // the call failed, so the old block lives on
+    if (old_id != TRACE_NO_ID) {
+      size_t slot     = table_slot((uintptr_t)ptr);
+      table[slot].ptr = (uintptr_t)ptr;
+      table[slot].id  = old_id;
+      live_blocks++;
+    }
+  } else {
+    new_id = add_block(new_ptr);
+  }
+  record(TRACE_REALLOC, size, new_id, old_id);
+  pthread_mutex_unlock(&lock);
+  return new_ptr;
+
+} // realloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void free (void* ptr) {
+
+  if (ptr == NULL || IS_BOOTSTRAP_PTR(ptr)) {
+    return;
+  }
+  if (!ready) {
+    if (initializing) {
+      // As for realloc(): unrecorded, and without the lock init() holds.
+      if (next_free != NULL) {
+        next_free(ptr);
+      }
+      return;
+    }
+    init();
+  }
+
+  pthread_mutex_lock(&lock);
+  record(TRACE_FREE, 0, remove_block(ptr), TRACE_NO_ID);
+  next_free(ptr);
+  pthread_mutex_unlock(&lock);
+
+} // free ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Write out whatever is still buffered as the process exits. */
+__attribute__ ((destructor))
+static void flush_at_exit () {
+
+  pthread_mutex_lock(&lock);
+  flush();
+  pthread_mutex_unlock(&lock);
+
+} // flush_at_exit ()
+// ==============================================================================
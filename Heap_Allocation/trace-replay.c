@@ -0,0 +1,208 @@
+// ==============================================================================
+/**
+ * trace-replay.c
+ *
+ * Plays back an allocation trace recorded by `libtrace.so` against whichever
+ * allocator is loaded, touching every page of each new block as a program
+ * would.  The calls are replayed in the order they were recorded, on a single
+ * thread.  Prints CSV: the number of calls, the time they took, the calls per
+ * second, the peak of the bytes the trace had live, the peak RSS the heap
+ * needed to hold them, and the fragmentation (the share of that RSS that was
+ * not live data), e.g.:
+ *
+ *   LD_PRELOAD=./libbf.so ./trace-replay app.trace
+ **/
+// ==============================================================================
+
+
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "trace.h"
+#include "test-util.h"
+
+/** The records read from the trace at a time. */
+#define CHUNK_RECORDS 65536
+
+/** The spacing of the bytes written to fault in a new block's pages. */
+#define TOUCH_STRIDE  4096
+
+/** A block of the trace, as replayed. */
+typedef struct replay_block {
+  char*  ptr;
+  size_t size;
+} replay_block_s;
+
+static trace_record_s chunk[CHUNK_RECORDS];
+
+/** Read the next chunk of records; returns how many were read. */
+static size_t read_chunk (int fd) {
+
+  size_t wanted = sizeof(chunk);
+  size_t got    = 0;
+  while (got < wanted) {
+    ssize_t bytes = read(fd, (char*)chunk + got, wanted - got);
+    if (bytes <= 0) {
+      break;
+    }
+    got += bytes;
+  }
+  return got / sizeof(trace_record_s);
+
+}
+
+/** Write to every page of a block from `from` onwards, so that it is resident. */
+static void touch (char* ptr, size_t from, size_t size) {
+
+  for (size_t offset = from; offset < size; offset += TOUCH_STRIDE) {
+    ptr[offset] = 1;
+  }
+  if (size > from) {
+    ptr[size - 1] = 1;
+  }
+
+}
+
+/** The current resident set size, in KB, read without allocating. */
+static long rss_kb () {
+
+  char buffer[64] = "";
+  int  statm      = open("/proc/self/statm", O_RDONLY);
+  if (statm >= 0) {
+    if (read(statm, buffer, sizeof(buffer) - 1) < 0) {
+      buffer[0] = '\0';
+    }
+    close(statm);
+  }
+  long pages = 0, resident = 0;
+  if (sscanf(buffer, "%ld %ld", &pages, &resident) != 2) {
+    resident = 0;
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+
+}
+
+int main (int argc, char **argv) {
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+    return 1;
+  }
+  int fd = open(argv[1], O_RDONLY);
+  if (fd < 0) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  // A first pass finds the highest id, to size the table of blocks.  The
+  // table comes straight from the OS, so that the allocator only sees the
+  // trace's own calls, and is faulted in before the baseline RSS is taken,
+  // so that it does not count as the heap's.
+  uint32_t max_id = 0;
+  for (size_t count = read_chunk(fd); count > 0; count = read_chunk(fd)) {
+    for (size_t i = 0; i < count; i++) {
+      if (chunk[i].id > max_id) {
+        max_id = chunk[i].id;
+      }
+    }
+  }
+  size_t          table_size = ((size_t)max_id + 1) * sizeof(replay_block_s);
+  replay_block_s* blocks     = mmap(NULL, table_size, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (blocks == MAP_FAILED) {
+    fprintf(stderr, "could not map a table for %u blocks\n", max_id);
+    return 1;
+  }
+  memset(blocks, 0, table_size);
+  lseek(fd, 0, SEEK_SET);
+
+  long   base_rss  = rss_kb();
+  long   ops       = 0;
+  size_t live      = 0;
+  size_t peak_live = 0;
+  double start     = now();
+
+  for (size_t count = read_chunk(fd); count > 0; count = read_chunk(fd)) {
+    for (size_t i = 0; i < count; i++) {
+
+      trace_record_s* entry = &chunk[i];
+      replay_block_s* block = &blocks[entry->id];
+      replay_block_s* old   = &blocks[entry->old_id];
+      ops++;
+
+      switch (entry->op) {
+
+      case TRACE_MALLOC:
+      case TRACE_CALLOC:
+        if (entry->id == TRACE_NO_ID) {
+          break; // it failed when recorded
+        }
+        block->ptr  = (entry->op == TRACE_MALLOC) ? malloc(entry->size) : calloc(entry->size, 1);
+        block->size = entry->size;
+        if (block->ptr == NULL) {
+          fprintf(stderr, "allocation of %lu bytes failed\n", (unsigned long)entry->size);
+          return 1;
+        }
+        touch(block->ptr, 0, block->size);
+        live += block->size;
+        break;
+
+      case TRACE_REALLOC:
+        if (entry->id == TRACE_NO_ID && entry->size != 0) {
+          break; // it failed when recorded
+        }
+        {
+          // An unknown old block was either NULL or allocated before
+          // recording began; either way, this becomes a fresh allocation.
+          char*  old_ptr  = (entry->old_id == TRACE_NO_ID) ? NULL : old->ptr;
+          size_t old_size = (entry->old_id == TRACE_NO_ID) ? 0 : old->size;
+          char*  new_ptr  = realloc(old_ptr, entry->size);
+          live -= old_size;
+          if (entry->size == 0) {
+            break;
+          }
+          if (new_ptr == NULL) {
+            fprintf(stderr, "reallocation to %lu bytes failed\n", (unsigned long)entry->size);
+            return 1;
+          }
+          block->ptr  = new_ptr;
+          block->size = entry->size;
+          touch(new_ptr, old_size, block->size);
+          live += block->size;
+        }
+        break;
+
+      case TRACE_FREE:
+        if (entry->id != TRACE_NO_ID) {
+          free(block->ptr);
+          live -= block->size;
+        }
+        break;
+
+      }
+
+      if (live > peak_live) {
+        peak_live = live;
+      }
+
+    }
+  }
+  double elapsed = now() - start;
+  close(fd);
+
+  long   heap_rss      = peak_rss_kb() - base_rss;
+  long   live_kb       = (long)(peak_live / 1024);
+  double fragmentation = (heap_rss > live_kb) ? 1.0 - (double)live_kb / heap_rss : 0.0;
+
+  printf("ops,seconds,ops_per_sec,peak_live_kb,peak_rss_kb,fragmentation\n");
+  printf("%ld,%.3f,%.0f,%ld,%ld,%.3f\n",
+         ops, elapsed, ops / elapsed, live_kb, heap_rss, fragmentation);
+  return 0;
+
+}
@@ -0,0 +1,78 @@
+// ==============================================================================
+/**
+ * trace.h
+ *
+ * The format of the allocation traces written by `libtrace.so` and read by
+ * `trace-replay`.  A trace is a flat sequence of fixed-size records in the
+ * order the calls completed, in the byte order of the machine that wrote it.
+ * Blocks are named by ids rather than addresses: each block that is handed
+ * out gets the next id, starting at 1, so ids are never reused.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_TRACE_H)
+#define _TRACE_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdint.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** The kinds of call recorded. */
+#define TRACE_MALLOC  1
+#define TRACE_CALLOC  2
+#define TRACE_REALLOC 3
+#define TRACE_FREE    4
+
+/** The id of no block: a failed allocation, or a block the trace never saw. */
+#define TRACE_NO_ID   0
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND STRUCTURES
+
+/** One call. */
+typedef struct trace_record {
+
+  /** When the call completed, in nanoseconds since the first record. */
+  uint64_t time_ns;
+
+  /** The bytes requested (`nmemb * size` for calloc(); 0 for free()). */
+  uint64_t size;
+
+  /** The block returned, or for free() the block freed. */
+  uint32_t id;
+
+  /** For realloc(), the block passed in. */
+  uint32_t old_id;
+
+  /** The calling thread, numbered from 1 in order of their first call. */
+  uint16_t thread;
+
+  /** The kind of call: one of the `TRACE_` constants. */
+  uint8_t  op;
+
+} __attribute__ ((packed)) trace_record_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _TRACE_H
+// ==============================================================================